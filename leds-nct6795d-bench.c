@@ -0,0 +1,904 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * NCT6795D/NCT6797D LED driver benchmarks
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ *
+ * Test module, built with NCT6795D_TESTS=1. It adds an LED device driving a
+ * simulated chip, nct6795d_led.1, and exposes benchmarks and checks of the
+ * driver under /sys/kernel/debug/nct6795d_sim/.
+ */
+
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/leds.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/platform_device.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/timekeeping.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#include "leds-nct6795d.h"
+#include "nct6795d-sim.h"
+#include "nct6795d-sio.h"
+
+/* Platform device id of the LED on the simulated chip */
+#define NCT6795D_BENCH_LED_ID 1
+
+/*
+ * Coexistence benchmark. A simulated sensor poller reads a register at a fixed
+ * period while the LED is driven at a fixed rate, to measure how LED updates
+ * delay sensor reads. Like the nct6775 hwmon driver, the poller is not a
+ * client of the Super I/O sessions: it requests the I/O region and enters the
+ * configuration mode by itself.
+ */
+struct nct6795d_bench {
+	struct nct6795d_sim *sim;
+	struct platform_device *pdev;
+	struct nct6795d_led *led;
+	struct dentry *dir;
+	/* Whether budget checks were enabled at load, and are to be released */
+	bool verify;
+
+	/* Serializes the control of the benchmark */
+	struct mutex lock;
+	struct task_struct *poller;
+	unsigned int poll_us;
+	struct hrtimer load_timer;
+	unsigned int load_hz;
+	bool load_high;
+
+	/* Results since the benchmark was last (re)started */
+	ktime_t start;
+	s64 start_commits;
+	u64 load_requests;
+	/* Protects latency, updated by the poller */
+	spinlock_t latency_lock;
+	struct nct6795d_hist latency;
+
+	/* Stress run: writers, then the result of the last run */
+	atomic64_t stress_updates;
+	/*
+	 * Serializes the requests of the writers with their recording, so the
+	 * last request recorded is the last one the driver received
+	 */
+	struct mutex stress_lock;
+	/* Intensities last set, and color last requested */
+	unsigned int stress_intensity[NUM_COLORS];
+	u8 stress_expected[NUM_COLORS];
+	u8 stress_got[NUM_COLORS];
+	unsigned int stress_writers;
+	s64 stress_ms;
+	s64 stress_commits;
+	bool stress_done;
+	bool stress_ok;
+
+	/* Blink run: software blinking by the LED core, then the hardware's */
+	unsigned int blink_delay_ms;
+	s64 blink_ms;
+	s64 blink_commits[2];
+	bool blink_done;
+
+	/* Instrumentation run: cost of forced commits in this build */
+	const char *instr_mode;
+	unsigned int instr_commits;
+	s64 instr_ns;
+	bool instr_done;
+};
+
+static struct nct6795d_bench nct6795d_bench;
+
+/*
+ * Read a register of the simulated chip as nct6775 does, from the request of
+ * the I/O region to its release. This waits for any session the LED holds.
+ */
+static bool nct6795d_bench_sensor_read(struct nct6795d_sim *sim)
+{
+	const struct nct6795d_io_ops *ops = &nct6795d_sim_io_ops;
+	u16 port = NCT6795D_SIM_BASE;
+
+	if (!ops->request(sim, port))
+		return false;
+
+	ops->outb(sim, 0x87, port);
+	ops->outb(sim, 0x87, port);
+	ops->outb(sim, SIO_REG_DEVID, port);
+	ops->inb(sim, port + 1);
+	ops->outb(sim, 0xaa, port);
+	ops->outb(sim, 0x02, port);
+	ops->outb(sim, 0x02, port + 1);
+	ops->release(sim, port);
+
+	return true;
+}
+
+static int nct6795d_bench_poll(void *data)
+{
+	struct nct6795d_bench *bench = data;
+	unsigned int poll_us = bench->poll_us;
+	unsigned long flags;
+	ktime_t start;
+
+	while (!kthread_should_stop()) {
+		start = ktime_get();
+		if (nct6795d_bench_sensor_read(bench->sim)) {
+			spin_lock_irqsave(&bench->latency_lock, flags);
+			nct6795d_hist_add(&bench->latency,
+					  ktime_to_ns(ktime_get() - start));
+			spin_unlock_irqrestore(&bench->latency_lock, flags);
+		}
+
+		usleep_range(poll_us, poll_us + poll_us / 8);
+	}
+
+	return 0;
+}
+
+static enum hrtimer_restart nct6795d_bench_load(struct hrtimer *timer)
+{
+	struct nct6795d_bench *bench = container_of(timer,
+						    struct nct6795d_bench,
+						    load_timer);
+	struct led_classdev *cdev = &bench->led->mc_cdev.led_cdev;
+
+	/* Alternate between two brightnesses, so every request is a change */
+	bench->load_high = !bench->load_high;
+	led_set_brightness(cdev, bench->load_high ? cdev->max_brightness :
+						    cdev->max_brightness / 2);
+	bench->load_requests++;
+
+	hrtimer_forward_now(timer, ns_to_ktime(NSEC_PER_SEC / bench->load_hz));
+	return HRTIMER_RESTART;
+}
+
+static void nct6795d_bench_stop(struct nct6795d_bench *bench)
+{
+	lockdep_assert_held(&bench->lock);
+
+	if (bench->poller) {
+		kthread_stop(bench->poller);
+		bench->poller = NULL;
+	}
+	hrtimer_cancel(&bench->load_timer);
+}
+
+/*
+ * (Re)start the benchmark with the current poll period and LED rate, and reset
+ * its results.
+ */
+static int nct6795d_bench_start(struct nct6795d_bench *bench)
+{
+	struct nct6795d_led *led = bench->led;
+	struct led_classdev *cdev = &led->mc_cdev.led_cdev;
+	unsigned long flags;
+	int i;
+
+	lockdep_assert_held(&bench->lock);
+
+	nct6795d_bench_stop(bench);
+
+	/* Commits are counted by the statistics */
+	nct6795d_led_key_set(&nct6795d_stats_enabled, true);
+
+	spin_lock_irqsave(&bench->latency_lock, flags);
+	memset(&bench->latency, 0, sizeof(bench->latency));
+	spin_unlock_irqrestore(&bench->latency_lock, flags);
+	bench->load_requests = 0;
+	bench->start_commits = atomic64_read(&led->stats.commits);
+	bench->start = ktime_get();
+
+	if (bench->poll_us) {
+		bench->poller = kthread_run(nct6795d_bench_poll, bench,
+					    "nct6795d-bench");
+		if (IS_ERR(bench->poller)) {
+			int ret = PTR_ERR(bench->poller);
+
+			bench->poller = NULL;
+			return ret;
+		}
+	}
+
+	if (bench->load_hz) {
+		/* Light all colors so that brightness changes reach the chip */
+		mutex_lock(&cdev->led_access);
+		for (i = 0; i < NUM_COLORS; i++)
+			led->subled[i].intensity = cdev->max_brightness;
+		mutex_unlock(&cdev->led_access);
+
+		hrtimer_start(&bench->load_timer,
+			      ns_to_ktime(NSEC_PER_SEC / bench->load_hz),
+			      HRTIMER_MODE_REL);
+	}
+
+	return 0;
+}
+
+static int nct6795d_bench_poll_us_get(void *data, u64 *val)
+{
+	struct nct6795d_bench *bench = data;
+
+	*val = bench->poll_us;
+
+	return 0;
+}
+
+static int nct6795d_bench_poll_us_set(void *data, u64 val)
+{
+	struct nct6795d_bench *bench = data;
+	int ret;
+
+	if (val > USEC_PER_SEC)
+		return -EINVAL;
+
+	mutex_lock(&bench->lock);
+	bench->poll_us = val;
+	ret = nct6795d_bench_start(bench);
+	mutex_unlock(&bench->lock);
+
+	return ret;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(nct6795d_bench_poll_us_fops,
+			 nct6795d_bench_poll_us_get,
+			 nct6795d_bench_poll_us_set, "%llu\n");
+
+static int nct6795d_bench_led_hz_get(void *data, u64 *val)
+{
+	struct nct6795d_bench *bench = data;
+
+	*val = bench->load_hz;
+
+	return 0;
+}
+
+static int nct6795d_bench_led_hz_set(void *data, u64 val)
+{
+	struct nct6795d_bench *bench = data;
+	int ret;
+
+	if (val > 1000)
+		return -EINVAL;
+
+	mutex_lock(&bench->lock);
+	/* The load timer divides by load_hz, stop it before changing it */
+	hrtimer_cancel(&bench->load_timer);
+	bench->load_hz = val;
+	ret = nct6795d_bench_start(bench);
+	mutex_unlock(&bench->lock);
+
+	return ret;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(nct6795d_bench_led_hz_fops,
+			 nct6795d_bench_led_hz_get,
+			 nct6795d_bench_led_hz_set, "%llu\n");
+
+static int nct6795d_bench_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_bench *bench = s->private;
+	struct nct6795d_hist latency;
+	unsigned long flags;
+	s64 elapsed_ms, commits;
+
+	mutex_lock(&bench->lock);
+
+	elapsed_ms = ktime_ms_delta(ktime_get(), bench->start);
+	commits = atomic64_read(&bench->led->stats.commits) -
+		  bench->start_commits;
+
+	seq_printf(s, "sensor_poll_us: %u\n", bench->poll_us);
+	seq_printf(s, "led_hz: %u\n", bench->load_hz);
+	seq_printf(s, "elapsed_ms: %lld\n", elapsed_ms);
+	seq_printf(s, "led_requests: %llu\n", bench->load_requests);
+	seq_printf(s, "commits: %lld\n", commits);
+	seq_printf(s, "commits_per_s: %lld\n",
+		   elapsed_ms ? div64_s64(commits * MSEC_PER_SEC, elapsed_ms) :
+				0);
+
+	mutex_unlock(&bench->lock);
+
+	spin_lock_irqsave(&bench->latency_lock, flags);
+	latency = bench->latency;
+	spin_unlock_irqrestore(&bench->latency_lock, flags);
+
+	nct6795d_hist_show(s, "sensor_latency", &latency);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nct6795d_bench);
+
+/*
+ * Record the color requested by a writer, computed from what it requested as
+ * led_mc_calc_color_components() does. Called with the stress lock held.
+ */
+static void nct6795d_stress_record(struct nct6795d_bench *bench,
+				   unsigned int brightness)
+{
+	unsigned int max = bench->led->mc_cdev.led_cdev.max_brightness;
+	int i;
+
+	lockdep_assert_held(&bench->stress_lock);
+
+	for (i = 0; i < NUM_COLORS; i++)
+		bench->stress_expected[i] =
+			bench->stress_intensity[i] * brightness / max;
+	atomic64_inc(&bench->stress_updates);
+}
+
+/*
+ * Stress writer: sets random intensities and brightness as fast as possible,
+ * as the brightness and multi_intensity sysfs files would.
+ */
+static int nct6795d_stress_writer(void *data)
+{
+	struct nct6795d_bench *bench = data;
+	struct nct6795d_led *led = bench->led;
+	struct led_classdev *cdev = &led->mc_cdev.led_cdev;
+	unsigned int brightness;
+	int i;
+
+	while (!kthread_should_stop()) {
+		mutex_lock(&bench->stress_lock);
+		mutex_lock(&cdev->led_access);
+
+		for (i = 0; i < NUM_COLORS; i++) {
+			bench->stress_intensity[i] =
+				get_random_u32() % (cdev->max_brightness + 1);
+			led->subled[i].intensity = bench->stress_intensity[i];
+		}
+		brightness = get_random_u32() % (cdev->max_brightness + 1);
+		led_set_brightness(cdev, brightness);
+
+		mutex_unlock(&cdev->led_access);
+		nct6795d_stress_record(bench, brightness);
+		mutex_unlock(&bench->stress_lock);
+
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * Stress trigger: sets random brightness as fast as possible through the LED
+ * core without the LED access lock, as a trigger would.
+ */
+static int nct6795d_stress_trigger(void *data)
+{
+	struct nct6795d_bench *bench = data;
+	struct led_classdev *cdev = &bench->led->mc_cdev.led_cdev;
+	unsigned int brightness;
+
+	while (!kthread_should_stop()) {
+		brightness = get_random_u32() % (cdev->max_brightness + 1);
+
+		mutex_lock(&bench->stress_lock);
+		led_set_brightness(cdev, brightness);
+		nct6795d_stress_record(bench, brightness);
+		mutex_unlock(&bench->stress_lock);
+
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * Run writers concurrently for ms, half of them as sysfs writers and the other
+ * half as triggers, then wait for the driver to quiesce and check that the
+ * simulated chip shows the color of the last request. The writers record what
+ * they requested, so a color the driver computed wrongly fails the check.
+ */
+static int nct6795d_stress_run(struct nct6795d_bench *bench,
+			       unsigned int writers, unsigned int ms)
+{
+	struct nct6795d_led *led = bench->led;
+	struct led_classdev *cdev = &led->mc_cdev.led_cdev;
+	struct nct6795d_sim *sim = bench->sim;
+	struct task_struct **threads;
+	unsigned long flags;
+	s64 start_commits;
+	ktime_t start;
+	int ret = 0;
+	int n, i, j;
+
+	threads = kcalloc(writers, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	mutex_lock(&bench->lock);
+
+	/* The LED load of the benchmark would be another writer */
+	hrtimer_cancel(&bench->load_timer);
+	bench->load_hz = 0;
+
+	/* Commits are counted by the statistics */
+	nct6795d_led_key_set(&nct6795d_stats_enabled, true);
+
+	atomic64_set(&bench->stress_updates, 0);
+	/* The trigger writers apply the intensities currently set */
+	mutex_lock(&cdev->led_access);
+	for (i = 0; i < NUM_COLORS; i++)
+		bench->stress_intensity[i] = led->subled[i].intensity;
+	mutex_unlock(&cdev->led_access);
+	start_commits = atomic64_read(&led->stats.commits);
+	start = ktime_get();
+
+	for (n = 0; n < writers; n++) {
+		threads[n] = kthread_run(n % 2 ? nct6795d_stress_trigger :
+						 nct6795d_stress_writer,
+					 bench, "nct6795d-stress/%d", n);
+		if (IS_ERR(threads[n])) {
+			ret = PTR_ERR(threads[n]);
+			break;
+		}
+	}
+
+	if (!ret)
+		msleep(ms);
+
+	for (i = 0; i < n; i++)
+		kthread_stop(threads[i]);
+	kfree(threads);
+
+	if (ret)
+		goto out;
+
+	/* Wait for the last request to be committed, retries included */
+	while (flush_delayed_work(&led->commit_work))
+		;
+
+	bench->stress_writers = writers;
+	bench->stress_ms = ktime_ms_delta(ktime_get(), start);
+	bench->stress_commits = atomic64_read(&led->stats.commits) -
+				start_commits;
+	bench->stress_ok = true;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	for (i = 0; i < NUM_COLORS; i++) {
+		const u8 *cell = &sim->regs[NCT6795D_RGB_BANK]
+					   [NCT6795D_RED_CELL +
+					    i * NCT6795D_CELL_SIZE];
+		u8 expected = bench->stress_expected[i];
+
+		bench->stress_got[i] = cell[0] >> 4;
+		for (j = 0; j < NCT6795D_CELL_SIZE; j++) {
+			if (cell[j] != (expected << 4 | expected))
+				bench->stress_ok = false;
+		}
+	}
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	bench->stress_done = true;
+
+out:
+	mutex_unlock(&bench->lock);
+	return ret;
+}
+
+static int nct6795d_stress_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_bench *bench = s->private;
+	s64 updates = atomic64_read(&bench->stress_updates);
+
+	mutex_lock(&bench->lock);
+
+	if (!bench->stress_done) {
+		seq_puts(s, "no run yet\n");
+		goto out;
+	}
+
+	seq_printf(s, "writers: %u\n", bench->stress_writers);
+	seq_printf(s, "elapsed_ms: %lld\n", bench->stress_ms);
+	seq_printf(s, "updates: %lld\n", updates);
+	seq_printf(s, "updates_per_s: %lld\n",
+		   bench->stress_ms ?
+			div64_s64(updates * MSEC_PER_SEC, bench->stress_ms) :
+			0);
+	seq_printf(s, "commits: %lld\n", bench->stress_commits);
+	seq_printf(s, "result: %s (expected %u %u %u, hardware %u %u %u)\n",
+		   bench->stress_ok ? "pass" : "FAIL",
+		   bench->stress_expected[RED], bench->stress_expected[GREEN],
+		   bench->stress_expected[BLUE], bench->stress_got[RED],
+		   bench->stress_got[GREEN], bench->stress_got[BLUE]);
+
+out:
+	mutex_unlock(&bench->lock);
+	return 0;
+}
+
+static int nct6795d_stress_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nct6795d_stress_show, inode->i_private);
+}
+
+/* Writing "<writers> <duration in ms>" runs the stress test */
+static ssize_t nct6795d_stress_write(struct file *file,
+				     const char __user *user_buf, size_t count,
+				     loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	unsigned int writers, ms;
+	char buf[32];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u", &writers, &ms) != 2 || !writers ||
+	    writers > 64 || !ms || ms > 60 * MSEC_PER_SEC)
+		return -EINVAL;
+
+	ret = nct6795d_stress_run(s->private, writers, ms);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations nct6795d_stress_fops = {
+	.owner = THIS_MODULE,
+	.open = nct6795d_stress_open,
+	.read = seq_read,
+	.write = nct6795d_stress_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Stands in for the blink_set hook of the driver to refuse any request */
+static int nct6795d_blink_bench_refuse(struct led_classdev *cdev,
+				       unsigned long *delay_on,
+				       unsigned long *delay_off)
+{
+	return -EINVAL;
+}
+
+/*
+ * Blink the LED for ms as the timer trigger does, and return the number of
+ * commits it took. With soft set, the blink_set hook of the driver is
+ * overridden while blinking is set up, so the LED core blinks by itself.
+ */
+static s64 nct6795d_blink_bench_pass(struct nct6795d_bench *bench,
+				     unsigned int delay_ms, unsigned int ms,
+				     bool soft)
+{
+	struct nct6795d_led *led = bench->led;
+	struct led_classdev *cdev = &led->mc_cdev.led_cdev;
+	unsigned long delay_on = delay_ms, delay_off = delay_ms;
+	int (*blink_set)(struct led_classdev *cdev, unsigned long *delay_on,
+			 unsigned long *delay_off);
+	s64 start_commits;
+
+	mutex_lock(&cdev->led_access);
+	blink_set = cdev->blink_set;
+	if (soft)
+		cdev->blink_set = nct6795d_blink_bench_refuse;
+	led_blink_set(cdev, &delay_on, &delay_off);
+	/* Software blinking does not call the hook again */
+	cdev->blink_set = blink_set;
+	mutex_unlock(&cdev->led_access);
+
+	/* Setting up the hardware blinking is not part of the cost */
+	flush_delayed_work(&led->commit_work);
+	start_commits = atomic64_read(&led->stats.commits);
+
+	msleep(ms);
+
+	start_commits = atomic64_read(&led->stats.commits) - start_commits;
+
+	mutex_lock(&cdev->led_access);
+	led_stop_software_blink(cdev);
+	led_set_brightness(cdev, LED_OFF);
+	mutex_unlock(&cdev->led_access);
+
+	while (flush_delayed_work(&led->commit_work))
+		;
+
+	return start_commits;
+}
+
+static int nct6795d_blink_bench_run(struct nct6795d_bench *bench,
+				    unsigned int delay_ms, unsigned int ms)
+{
+	mutex_lock(&bench->lock);
+
+	/* The LED load of the benchmark would add its own commits */
+	hrtimer_cancel(&bench->load_timer);
+	bench->load_hz = 0;
+
+	/* Commits are counted by the statistics */
+	nct6795d_led_key_set(&nct6795d_stats_enabled, true);
+
+	bench->blink_commits[0] = nct6795d_blink_bench_pass(bench, delay_ms,
+							    ms, true);
+	bench->blink_commits[1] = nct6795d_blink_bench_pass(bench, delay_ms,
+							    ms, false);
+	bench->blink_delay_ms = delay_ms;
+	bench->blink_ms = ms;
+	bench->blink_done = true;
+
+	mutex_unlock(&bench->lock);
+	return 0;
+}
+
+static int nct6795d_blink_bench_show(struct seq_file *s, void *data)
+{
+	static const char * const modes[] = { "software", "hardware" };
+	struct nct6795d_bench *bench = s->private;
+	int i;
+
+	mutex_lock(&bench->lock);
+
+	if (!bench->blink_done) {
+		seq_puts(s, "no run yet\n");
+		goto out;
+	}
+
+	seq_printf(s, "delay_ms: %u\n", bench->blink_delay_ms);
+	seq_printf(s, "elapsed_ms: %lld\n", bench->blink_ms);
+	for (i = 0; i < ARRAY_SIZE(modes); i++) {
+		seq_printf(s, "%s_commits: %lld\n", modes[i],
+			   bench->blink_commits[i]);
+		/* Each commit is a wakeup of the commit work */
+		seq_printf(s, "%s_commits_per_s: %lld\n", modes[i],
+			   div64_s64(bench->blink_commits[i] * MSEC_PER_SEC,
+				     bench->blink_ms));
+	}
+
+out:
+	mutex_unlock(&bench->lock);
+	return 0;
+}
+
+static int nct6795d_blink_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nct6795d_blink_bench_show, inode->i_private);
+}
+
+/* Writing "<delay_on/off in ms> <duration in ms>" runs the benchmark */
+static ssize_t nct6795d_blink_bench_write(struct file *file,
+					  const char __user *user_buf,
+					  size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	unsigned int delay_ms, ms;
+	char buf[32];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u", &delay_ms, &ms) != 2 || !delay_ms ||
+	    delay_ms > 10 * MSEC_PER_SEC || !ms || ms > 60 * MSEC_PER_SEC)
+		return -EINVAL;
+
+	ret = nct6795d_blink_bench_run(s->private, delay_ms, ms);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations nct6795d_blink_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = nct6795d_blink_bench_open,
+	.read = seq_read,
+	.write = nct6795d_blink_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * Time n forced commits, which go through all the instrumented paths, to
+ * compare the cost of the instrumentation when disabled with a build where it
+ * is compiled out.
+ */
+static int nct6795d_instr_bench_run(struct nct6795d_bench *bench,
+				    unsigned int n)
+{
+	struct nct6795d_led *led = bench->led;
+	unsigned int i;
+	ktime_t start;
+	int ret = 0;
+
+	mutex_lock(&bench->lock);
+
+	/* The LED load of the benchmark would add its own commits */
+	hrtimer_cancel(&bench->load_timer);
+	bench->load_hz = 0;
+
+	if (!NCT6795D_INSTRUMENTATION)
+		bench->instr_mode = "compiled out";
+	else if (static_key_enabled(&nct6795d_stats_enabled) ||
+		 static_key_enabled(&nct6795d_verify_enabled))
+		bench->instr_mode = "enabled";
+	else
+		bench->instr_mode = "disabled";
+
+	while (flush_delayed_work(&led->commit_work))
+		;
+
+	mutex_lock(&led->io_lock);
+	/* Measure the commits, not entering the configuration mode */
+	nct6795d_sio_get(led->client);
+
+	start = ktime_get();
+	for (i = 0; i < n; i++) {
+		ret = nct6795d_led_commit(led, true);
+		if (ret)
+			break;
+	}
+	bench->instr_ns = ktime_ns_delta(ktime_get(), start);
+
+	nct6795d_sio_put(led->client);
+	mutex_unlock(&led->io_lock);
+
+	bench->instr_commits = i;
+	bench->instr_done = true;
+
+	mutex_unlock(&bench->lock);
+	return ret;
+}
+
+static int nct6795d_instr_bench_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_bench *bench = s->private;
+
+	mutex_lock(&bench->lock);
+
+	if (!bench->instr_done) {
+		seq_puts(s, "no run yet\n");
+		goto out;
+	}
+
+	seq_printf(s, "instrumentation: %s\n", bench->instr_mode);
+	seq_printf(s, "commits: %u\n", bench->instr_commits);
+	seq_printf(s, "elapsed_ns: %lld\n", bench->instr_ns);
+	seq_printf(s, "ns_per_commit: %lld\n",
+		   bench->instr_commits ?
+			div_s64(bench->instr_ns, bench->instr_commits) :
+			0);
+
+out:
+	mutex_unlock(&bench->lock);
+	return 0;
+}
+
+static int nct6795d_instr_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nct6795d_instr_bench_show, inode->i_private);
+}
+
+/* Writing a number of commits runs the benchmark */
+static ssize_t nct6795d_instr_bench_write(struct file *file,
+					  const char __user *user_buf,
+					  size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	unsigned int n;
+	int ret;
+
+	ret = kstrtouint_from_user(user_buf, count, 0, &n);
+	if (ret)
+		return ret;
+	if (!n || n > 1000000)
+		return -EINVAL;
+
+	ret = nct6795d_instr_bench_run(s->private, n);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations nct6795d_instr_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = nct6795d_instr_bench_open,
+	.read = seq_read,
+	.write = nct6795d_instr_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void nct6795d_bench_debugfs_init(struct nct6795d_bench *bench)
+{
+	struct nct6795d_sim *sim = bench->sim;
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("nct6795d_sim", NULL);
+	bench->dir = dir;
+
+	debugfs_create_u64("reads", 0444, dir, &sim->reads);
+	debugfs_create_u64("writes", 0444, dir, &sim->writes);
+	debugfs_create_u64("sessions", 0444, dir, &sim->sessions);
+	debugfs_create_u64("config_ns", 0444, dir, &sim->config_ns);
+
+	debugfs_create_file("stress", 0644, dir, bench, &nct6795d_stress_fops);
+	debugfs_create_file("instr_bench", 0644, dir, bench,
+			    &nct6795d_instr_bench_fops);
+
+	/* These report figures collected by the instrumentation */
+	if (NCT6795D_INSTRUMENTATION) {
+		debugfs_create_file_unsafe("bench_sensor_poll_us", 0644, dir,
+					   bench, &nct6795d_bench_poll_us_fops);
+		debugfs_create_file_unsafe("bench_led_hz", 0644, dir, bench,
+					   &nct6795d_bench_led_hz_fops);
+		debugfs_create_file("bench", 0444, dir, bench,
+				    &nct6795d_bench_fops);
+		debugfs_create_file("blink_bench", 0644, dir, bench,
+				    &nct6795d_blink_bench_fops);
+	}
+}
+
+static int __init nct6795d_bench_init(void)
+{
+	struct nct6795d_bench *bench = &nct6795d_bench;
+	int ret;
+
+	mutex_init(&bench->lock);
+	mutex_init(&bench->stress_lock);
+	spin_lock_init(&bench->latency_lock);
+	hrtimer_setup(&bench->load_timer, nct6795d_bench_load, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+
+	bench->sim = nct6795d_sim_create();
+	if (!bench->sim)
+		return -ENOMEM;
+
+	/* The simulator is where budget overruns are looked for */
+	bench->verify = !static_key_enabled(&nct6795d_verify_enabled);
+	nct6795d_led_key_set(&nct6795d_verify_enabled, true);
+
+	bench->pdev = nct6795d_sim_add_led(bench->sim, NCT6795D_BENCH_LED_ID,
+					   false);
+	if (IS_ERR(bench->pdev)) {
+		ret = PTR_ERR(bench->pdev);
+		goto error_add;
+	}
+
+	bench->led = platform_get_drvdata(bench->pdev);
+	bench->start = ktime_get();
+	nct6795d_bench_debugfs_init(bench);
+
+	return 0;
+
+error_add:
+	if (bench->verify)
+		nct6795d_led_key_set(&nct6795d_verify_enabled, false);
+	nct6795d_sim_destroy(bench->sim);
+	return ret;
+}
+
+static void __exit nct6795d_bench_exit(void)
+{
+	struct nct6795d_bench *bench = &nct6795d_bench;
+
+	/* Removed first, so they cannot restart the benchmark */
+	debugfs_remove_recursive(bench->dir);
+
+	mutex_lock(&bench->lock);
+	nct6795d_bench_stop(bench);
+	mutex_unlock(&bench->lock);
+
+	platform_device_unregister(bench->pdev);
+	if (bench->verify)
+		nct6795d_led_key_set(&nct6795d_verify_enabled, false);
+	nct6795d_sim_destroy(bench->sim);
+}
+
+module_init(nct6795d_bench_init);
+module_exit(nct6795d_bench_exit);
+
+MODULE_AUTHOR("Alexandre Courbot <gnurou@gmail.com>");
+MODULE_DESCRIPTION("Benchmarks of the NCT6795D LED driver on a simulated chip");
+MODULE_LICENSE("GPL");
+MODULE_IMPORT_NS("NCT6795D_TESTS");
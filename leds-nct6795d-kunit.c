@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * NCT6795D/NCT6797D LED driver port I/O tests
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ *
+ * Part of the test module, built with NCT6795D_TESTS=1 against a kernel with
+ * CONFIG_KUNIT. Each case adds an LED on its own simulated chip and checks the
+ * exact port I/O of one operation, as counted by the simulator.
+ */
+
+#include <kunit/test.h>
+#include <linux/platform_device.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+
+#include "leds-nct6795d.h"
+#include "nct6795d-sim.h"
+#include "nct6795d-sio.h"
+
+/*
+ * Port I/O of each operation, starting and ending with the session closed.
+ * Entering costs 2 writes, exiting 3, selecting a logical device 2, writing a
+ * register 2 and reading one 1 write and 1 read. The runtime budgets of the
+ * driver are ceilings of these.
+ */
+static const struct nct6795d_io_count nct6795d_kunit_costs[] = {
+	/*
+	 * Enter, then select and read-modify-write each enable register of a
+	 * blank chip (12 writes), then force the 15 state registers (30)
+	 */
+	[NCT6795D_OP_PROBE] = { .reads = 2, .writes = 45, .sessions = 1 },
+	/*
+	 * Enter, then select and read each enable register, already set by the
+	 * firmware (8 writes), then read the 15 state registers. They are all
+	 * adopted, so none is written.
+	 */
+	[NCT6795D_OP_PROBE_ADOPT] = { .reads = 17,
+				      .writes = 26,
+				      .sessions = 1 },
+	/* Enter, then select and read each enable register, already set */
+	[NCT6795D_OP_SETUP] = { .reads = 2, .writes = 11, .sessions = 1 },
+	[NCT6795D_OP_COMMIT_NOOP] = { .reads = 0, .writes = 0, .sessions = 0 },
+	/* Enter, select, then write the 4 registers of the cell */
+	[NCT6795D_OP_COMMIT_SINGLE] = { .reads = 0,
+					.writes = 15,
+					.sessions = 1 },
+	/* Enter, select, then write the 12 color registers and PARAMS_1 */
+	[NCT6795D_OP_COMMIT_FULL] = { .reads = 0, .writes = 33, .sessions = 1 },
+	/*
+	 * Setup with the RGB enable register lost (10 writes), then read the 15
+	 * state registers and rewrite all but PARAMS_0, which value was 0
+	 */
+	[NCT6795D_OP_RESUME] = { .reads = 17, .writes = 56, .sessions = 1 },
+};
+
+struct nct6795d_kunit {
+	struct nct6795d_sim *sim;
+	struct platform_device *pdev;
+	struct nct6795d_led *led;
+	/* Counters of the simulator when the measured operation started */
+	struct nct6795d_io_count start;
+};
+
+static unsigned int nct6795d_kunit_chunk_hold_us;
+
+static void nct6795d_kunit_count(struct nct6795d_sim *sim,
+				 struct nct6795d_io_count *count)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	count->reads = sim->reads;
+	count->writes = sim->writes;
+	count->sessions = sim->sessions;
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+static void nct6795d_kunit_add_led(struct kunit *test, bool adopt)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+	struct platform_device *pdev;
+
+	pdev = nct6795d_sim_add_led(ctx->sim, PLATFORM_DEVID_AUTO, adopt);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pdev);
+
+	ctx->pdev = pdev;
+	ctx->led = platform_get_drvdata(pdev);
+}
+
+/*
+ * Start measuring an operation, with the session closed as it is in the worst
+ * case.
+ */
+static void nct6795d_kunit_begin(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+
+	if (ctx->led) {
+		flush_delayed_work(&ctx->led->commit_work);
+		nct6795d_sio_flush(ctx->led->client);
+	}
+
+	nct6795d_kunit_count(ctx->sim, &ctx->start);
+}
+
+/* Check the port I/O since nct6795d_kunit_begin(), including the exit */
+static void nct6795d_kunit_expect(struct kunit *test, enum nct6795d_op op)
+{
+	const struct nct6795d_io_count *want = &nct6795d_kunit_costs[op];
+	struct nct6795d_kunit *ctx = test->priv;
+	struct nct6795d_io_count got;
+
+	nct6795d_sio_flush(ctx->led->client);
+	nct6795d_kunit_count(ctx->sim, &got);
+	got.reads -= ctx->start.reads;
+	got.writes -= ctx->start.writes;
+	got.sessions -= ctx->start.sessions;
+
+	KUNIT_EXPECT_TRUE_MSG(test,
+			      got.reads == want->reads &&
+			      got.writes == want->writes &&
+			      got.sessions == want->sessions,
+			      "reads/writes/sessions: expected %llu/%llu/%llu, got %llu/%llu/%llu",
+			      want->reads, want->writes, want->sessions,
+			      got.reads, got.writes, got.sessions);
+}
+
+static int nct6795d_kunit_commit(struct nct6795d_led *led)
+{
+	int ret;
+
+	mutex_lock(&led->io_lock);
+	ret = nct6795d_led_commit(led, false);
+	mutex_unlock(&led->io_lock);
+
+	return ret;
+}
+
+static void nct6795d_kunit_probe(struct kunit *test)
+{
+	nct6795d_kunit_begin(test);
+	nct6795d_kunit_add_led(test, false);
+	nct6795d_kunit_expect(test, NCT6795D_OP_PROBE);
+}
+
+static void nct6795d_kunit_probe_adopt(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+	u8 *rgb = ctx->sim->regs[NCT6795D_RGB_BANK];
+
+	/* RGB control enabled by the firmware, with a static color */
+	ctx->sim->regs[NCT6795D_LD09][NCT6795D_LD09_ENABLE] = 0x10;
+	rgb[NCT6795D_RGB_ENABLE] = 0xe0;
+	rgb[NCT6795D_PARAMS_0] = PARAMS_0_LED_ENABLE(true);
+	memset(&rgb[NCT6795D_RED_CELL], 0xff, NCT6795D_CELL_SIZE);
+	memset(&rgb[NCT6795D_GREEN_CELL], 0x88, NCT6795D_CELL_SIZE);
+	memset(&rgb[NCT6795D_BLUE_CELL], 0x00, NCT6795D_CELL_SIZE);
+	rgb[NCT6795D_PARAMS_1] = PARAMS_1_STEP_DURATION_LOW(0x19);
+	rgb[NCT6795D_PARAMS_2] = PARAMS_2_FADE_COLOR(false, false, false) |
+				 PARAMS_2_DISABLE_BOARD_LED;
+
+	nct6795d_kunit_begin(test);
+	nct6795d_kunit_add_led(test, true);
+	nct6795d_kunit_expect(test, NCT6795D_OP_PROBE_ADOPT);
+
+	KUNIT_EXPECT_EQ(test, ctx->led->state.frames[GREEN][0], 0x8);
+	KUNIT_EXPECT_EQ(test, ctx->led->state.step_duration, 0x19);
+}
+
+static void nct6795d_kunit_setup(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+	int ret;
+
+	nct6795d_kunit_add_led(test, false);
+
+	nct6795d_kunit_begin(test);
+	mutex_lock(&ctx->led->io_lock);
+	ret = nct6795d_led_setup(ctx->led);
+	mutex_unlock(&ctx->led->io_lock);
+	KUNIT_EXPECT_EQ(test, ret, 0);
+	nct6795d_kunit_expect(test, NCT6795D_OP_SETUP);
+}
+
+static void nct6795d_kunit_commit_full(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+	struct nct6795d_led *led;
+	unsigned long flags;
+	int i, j;
+
+	nct6795d_kunit_add_led(test, false);
+	led = ctx->led;
+
+	/* Change every color register and the step duration */
+	spin_lock_irqsave(&led->lock, flags);
+	for (i = 0; i < NUM_COLORS; i++)
+		for (j = 0; j < NCT6795D_NUM_FRAMES; j++)
+			led->state.frames[i][j] =
+				(led->state.frames[i][j] + 1) & 0xf;
+	led->state.step_duration ^= 1;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_kunit_begin(test);
+	KUNIT_EXPECT_EQ(test, nct6795d_kunit_commit(led), 0);
+	nct6795d_kunit_expect(test, NCT6795D_OP_COMMIT_FULL);
+}
+
+static void nct6795d_kunit_commit_single(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+	struct nct6795d_led *led;
+	unsigned long flags;
+	int j;
+
+	nct6795d_kunit_add_led(test, false);
+	led = ctx->led;
+
+	spin_lock_irqsave(&led->lock, flags);
+	for (j = 0; j < NCT6795D_NUM_FRAMES; j++)
+		led->state.frames[RED][j] = (led->state.frames[RED][j] + 1) &
+					    0xf;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_kunit_begin(test);
+	KUNIT_EXPECT_EQ(test, nct6795d_kunit_commit(led), 0);
+	nct6795d_kunit_expect(test, NCT6795D_OP_COMMIT_SINGLE);
+}
+
+static void nct6795d_kunit_commit_noop(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+
+	nct6795d_kunit_add_led(test, false);
+
+	nct6795d_kunit_begin(test);
+	KUNIT_EXPECT_EQ(test, nct6795d_kunit_commit(ctx->led), 0);
+	nct6795d_kunit_expect(test, NCT6795D_OP_COMMIT_NOOP);
+}
+
+static void nct6795d_kunit_resume(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+	u8 *rgb = ctx->sim->regs[NCT6795D_RGB_BANK];
+	struct nct6795d_led *led;
+	unsigned long flags;
+
+	nct6795d_kunit_add_led(test, false);
+	led = ctx->led;
+
+	/* Lit LED, which PARAMS_0 is 0 and other state registers are not */
+	spin_lock_irqsave(&led->lock, flags);
+	led->state = (struct nct6795d_led_state){
+		.step_duration = 0x19,
+		.enable = true,
+	};
+	memset(led->state.frames, 0x5, sizeof(led->state.frames));
+	spin_unlock_irqrestore(&led->lock, flags);
+	KUNIT_ASSERT_EQ(test, nct6795d_kunit_commit(led), 0);
+
+	/* Suspend during which the chip lost the state of its RGB bank */
+	spin_lock_irqsave(&ctx->sim->lock, flags);
+	memset(&rgb[NCT6795D_RGB_ENABLE], 0, 0x100 - NCT6795D_RGB_ENABLE);
+	spin_unlock_irqrestore(&ctx->sim->lock, flags);
+
+	nct6795d_kunit_begin(test);
+	nct6795d_led_restore_work(&led->restore_work);
+	nct6795d_kunit_expect(test, NCT6795D_OP_RESUME);
+
+	KUNIT_EXPECT_EQ(test, rgb[NCT6795D_RGB_ENABLE], 0xe0);
+	KUNIT_EXPECT_EQ(test, rgb[NCT6795D_LAST_CELL], 0x55);
+}
+
+static int nct6795d_kunit_init(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->sim = nct6795d_sim_create();
+	if (!ctx->sim)
+		return -ENOMEM;
+
+	test->priv = ctx;
+	return 0;
+}
+
+static void nct6795d_kunit_exit(struct kunit *test)
+{
+	struct nct6795d_kunit *ctx = test->priv;
+
+	if (ctx->pdev)
+		platform_device_unregister(ctx->pdev);
+	nct6795d_sim_destroy(ctx->sim);
+}
+
+static int nct6795d_kunit_suite_init(struct kunit_suite *suite)
+{
+	/* Yields would split the measured operations into several sessions */
+	nct6795d_kunit_chunk_hold_us = nct6795d_sio_set_chunk_hold_us(0);
+	return 0;
+}
+
+static void nct6795d_kunit_suite_exit(struct kunit_suite *suite)
+{
+	nct6795d_sio_set_chunk_hold_us(nct6795d_kunit_chunk_hold_us);
+}
+
+static struct kunit_case nct6795d_kunit_cases[] = {
+	KUNIT_CASE(nct6795d_kunit_probe),
+	KUNIT_CASE(nct6795d_kunit_probe_adopt),
+	KUNIT_CASE(nct6795d_kunit_setup),
+	KUNIT_CASE(nct6795d_kunit_commit_full),
+	KUNIT_CASE(nct6795d_kunit_commit_single),
+	KUNIT_CASE(nct6795d_kunit_commit_noop),
+	KUNIT_CASE(nct6795d_kunit_resume),
+	{}
+};
+
+static struct kunit_suite nct6795d_kunit_suite = {
+	.name = "nct6795d_led",
+	.init = nct6795d_kunit_init,
+	.exit = nct6795d_kunit_exit,
+	.suite_init = nct6795d_kunit_suite_init,
+	.suite_exit = nct6795d_kunit_suite_exit,
+	.test_cases = nct6795d_kunit_cases,
+};
+kunit_test_suite(nct6795d_kunit_suite);
@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * NCT6795D/NCT6797D LED driver trace events
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nct6795d_led
+
+#if !defined(_LEDS_NCT6795D_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _LEDS_NCT6795D_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(nct6795d_led_commit_start,
+	TP_PROTO(u8 r, u8 g, u8 b),
+	TP_ARGS(r, g, b),
+
+	TP_STRUCT__entry(
+		__field(u8, r)
+		__field(u8, g)
+		__field(u8, b)
+	),
+
+	TP_fast_assign(
+		__entry->r = r;
+		__entry->g = g;
+		__entry->b = b;
+	),
+
+	TP_printk("R=%u G=%u B=%u", __entry->r, __entry->g, __entry->b)
+);
+
+TRACE_EVENT(nct6795d_led_commit_end,
+	TP_PROTO(u8 r, u8 g, u8 b, int written, int ret),
+	TP_ARGS(r, g, b, written, ret),
+
+	TP_STRUCT__entry(
+		__field(u8, r)
+		__field(u8, g)
+		__field(u8, b)
+		__field(int, written)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->r = r;
+		__entry->g = g;
+		__entry->b = b;
+		__entry->written = written;
+		__entry->ret = ret;
+	),
+
+	TP_printk("R=%u G=%u B=%u written=%d ret=%d", __entry->r, __entry->g,
+		  __entry->b, __entry->written, __entry->ret)
+);
+
+DECLARE_EVENT_CLASS(nct6795d_led_op,
+	TP_PROTO(s64 duration_ns, int ret),
+	TP_ARGS(duration_ns, ret),
+
+	TP_STRUCT__entry(
+		__field(s64, duration_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->duration_ns = duration_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("duration_ns=%lld ret=%d", __entry->duration_ns,
+		  __entry->ret)
+);
+
+DEFINE_EVENT(nct6795d_led_op, nct6795d_led_setup,
+	TP_PROTO(s64 duration_ns, int ret),
+	TP_ARGS(duration_ns, ret)
+);
+
+DEFINE_EVENT(nct6795d_led_op, nct6795d_led_resume,
+	TP_PROTO(s64 duration_ns, int ret),
+	TP_ARGS(duration_ns, ret)
+);
+
+#endif /* _LEDS_NCT6795D_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE leds-nct6795d-trace
+#include <trace/define_trace.h>
@@ -10,7 +10,8 @@
  * kernel LED interface.
  *
  * It is more limited than the original program due to limitations in the LED
- * interface. For now, only static colors are supported.
+ * interface. For now, only static colors and simple patterns (through the
+ * pattern trigger's hw_pattern) are supported.
  *
  * Supported motherboards (a per MSI-RGB's README):
  * B350 MORTAR ARCTIC
@@ -32,105 +33,279 @@
  *
  */
 
-#include <linux/io.h>
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
 #include <linux/init.h>
-#include <linux/io.h>
-#include <linux/ioport.h>
+#include <linux/jump_label.h>
 #include <linux/kernel.h>
 #include <linux/leds.h>
 #include <linux/led-class-multicolor.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/regmap.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+#include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+
+#include "leds-nct6795d.h"
+#include "nct6795d-sio.h"
+
+#ifndef NCT6795D_NO_INSTRUMENTATION
+#define CREATE_TRACE_POINTS
+#endif
+#include "leds-nct6795d-trace.h"
 
-/* Adapted from drivers/hwmon/nct6775.c */
-
-#define SIO_REG_LDSEL 0x07 /* Logical device select */
-#define SIO_REG_DEVID 0x20 /* Device ID (2 bytes) */
+/*
+ * Instrumentation is disabled by default and toggled through debugfs. When
+ * disabled, it costs a patched out branch. It can also be compiled out, see
+ * NCT6795D_INSTRUMENTATION.
+ */
+/* Collection of statistics */
+VISIBLE_IF_NCT6795D_TESTS DEFINE_STATIC_KEY_FALSE(nct6795d_stats_enabled);
+EXPORT_SYMBOL_IF_NCT6795D_TESTS(nct6795d_stats_enabled);
+/* Checking of the port I/O of each operation against its budget */
+VISIBLE_IF_NCT6795D_TESTS DEFINE_STATIC_KEY_FALSE(nct6795d_verify_enabled);
+EXPORT_SYMBOL_IF_NCT6795D_TESTS(nct6795d_verify_enabled);
+
+#define nct6795d_stats_on()                                                    \
+	(NCT6795D_INSTRUMENTATION &&                                           \
+	 static_branch_unlikely(&nct6795d_stats_enabled))
+#define nct6795d_verify_on()                                                   \
+	(NCT6795D_INSTRUMENTATION &&                                           \
+	 static_branch_unlikely(&nct6795d_verify_enabled))
+/* Probe, resume and restore are timed along with any instrumentation */
+#define nct6795d_timing_on() (nct6795d_stats_on() || nct6795d_verify_on())
+
+/* Serializes the toggling of the keys */
+static DEFINE_MUTEX(nct6795d_key_lock);
 
-static inline void superio_outb(int ioreg, int reg, int val)
+/*
+ * Enable or disable one of the instrumentation keys. Both need the port I/O to
+ * be accounted by the Super I/O sessions, which is kept enabled while any of
+ * them is.
+ */
+VISIBLE_IF_NCT6795D_TESTS void
+nct6795d_led_key_set(struct static_key_false *key, bool enable)
 {
-	outb(reg, ioreg);
-	outb(val, ioreg + 1);
+	mutex_lock(&nct6795d_key_lock);
+
+	if (enable && !static_key_enabled(key)) {
+		nct6795d_sio_accounting_get();
+		static_branch_enable(key);
+	} else if (!enable && static_key_enabled(key)) {
+		static_branch_disable(key);
+		nct6795d_sio_accounting_put();
+	}
+
+	mutex_unlock(&nct6795d_key_lock);
 }
+EXPORT_SYMBOL_IF_NCT6795D_TESTS(nct6795d_led_key_set);
+
+#define DEFAULT_STEP_DURATION 25
+
+static unsigned int commit_delay_ms = 10;
+module_param(commit_delay_ms, uint, 0644);
+MODULE_PARM_DESC(commit_delay_ms,
+		 "Maximum time in ms a color change can be delayed to be coalesced with subsequent ones (default: 10)");
+
+static unsigned int r;
+module_param(r, uint, 0444);
+MODULE_PARM_DESC(r, "Initial red intensity, 0-15 (default: 0)");
+static unsigned int g;
+module_param(g, uint, 0444);
+MODULE_PARM_DESC(g, "Initial green intensity, 0-15 (default: 0)");
+static unsigned int b;
+module_param(b, uint, 0444);
+MODULE_PARM_DESC(b, "Initial blue intensity, 0-15 (default: 0)");
+
+static bool adopt;
+module_param(adopt, bool, 0444);
+MODULE_PARM_DESC(adopt,
+		 "Keep the color set by the firmware at probe, ignoring r, g and b (default: false)");
+
+static bool lazy_setup;
+module_param(lazy_setup, bool, 0444);
+MODULE_PARM_DESC(lazy_setup,
+		 "Defer the setup of the chip until the LED is first used (default: false)");
 
-static inline int superio_inb(int ioreg, int reg)
+/*
+ * Nominal blink period in ms for each value of PARAMS_0_BLINK_DURATION, the
+ * LED being on for half of it. 0 means no blinking. These are approximations
+ * which have not been measured on hardware.
+ */
+static const unsigned int nct6795d_blink_periods[] = {
+	0, 250, 500, 750, 1000, 1250, 1500, 1750,
+};
+#define NCT6795D_DEFAULT_BLINK 2
+
+/*
+ * The registers are accessed through a regmap using the following address
+ * space:
+ * 0x00-0x1f: registers 0xe0-0xff of the RGB bank,
+ * 0x20: enable register of logical device 0x09.
+ */
+#define NCT6795D_REG(r) ((r) - NCT6795D_RGB_ENABLE)
+#define NCT6795D_REG_LD09_ENABLE 0x20
+#define NCT6795D_MAX_REG NCT6795D_REG_LD09_ENABLE
+
+static void nct6795d_reg_to_hw(unsigned int reg, int *ld, u8 *hw_reg)
 {
-	outb(reg, ioreg);
-	return inb(ioreg + 1);
+	if (reg == NCT6795D_REG_LD09_ENABLE) {
+		*ld = NCT6795D_LD09;
+		*hw_reg = NCT6795D_LD09_ENABLE;
+	} else {
+		*ld = NCT6795D_RGB_BANK;
+		*hw_reg = reg + NCT6795D_RGB_ENABLE;
+	}
 }
 
-static inline void superio_select(int ioreg, int ld)
+static int nct6795d_regmap_reg_read(void *context, unsigned int reg,
+				    unsigned int *val)
 {
-	outb(SIO_REG_LDSEL, ioreg);
-	outb(ld, ioreg + 1);
+	struct nct6795d_sio_client *client = context;
+	u8 hw_reg;
+	int ret;
+	int ld;
+
+	nct6795d_reg_to_hw(reg, &ld, &hw_reg);
+
+	ret = nct6795d_sio_begin(client);
+	if (ret)
+		return ret;
+
+	nct6795d_sio_select(client, ld);
+	*val = nct6795d_sio_inb(client, hw_reg);
+
+	nct6795d_sio_end(client);
+	return 0;
 }
 
-static int superio_enter(int ioreg)
+static int nct6795d_regmap_reg_write(void *context, unsigned int reg,
+				     unsigned int val)
 {
-	if (!request_muxed_region(ioreg, 2, "NCT6795D LED"))
-		return -EBUSY;
+	struct nct6795d_sio_client *client = context;
+	u8 hw_reg;
+	int ret;
+	int ld;
+
+	nct6795d_reg_to_hw(reg, &ld, &hw_reg);
 
-	outb(0x87, ioreg);
-	outb(0x87, ioreg);
+	ret = nct6795d_sio_begin(client);
+	if (ret)
+		return ret;
 
+	nct6795d_sio_select(client, ld);
+	nct6795d_sio_outb(client, hw_reg, val);
+
+	nct6795d_sio_end(client);
 	return 0;
 }
 
-static void superio_exit(int ioreg)
+static const struct regmap_bus nct6795d_regmap_bus = {
+	.reg_read = nct6795d_regmap_reg_read,
+	.reg_write = nct6795d_regmap_reg_write,
+};
+
+static bool nct6795d_regmap_accessible(struct device *dev, unsigned int reg)
 {
-	outb(0xaa, ioreg);
-	outb(0x02, ioreg);
-	outb(0x02, ioreg + 1);
-	release_region(ioreg, 2);
+	switch (reg) {
+	case NCT6795D_REG(NCT6795D_RGB_ENABLE):
+	case NCT6795D_REG(NCT6795D_PARAMS_0):
+	case NCT6795D_REG(NCT6795D_RED_CELL) ...
+	     NCT6795D_REG(NCT6795D_LAST_CELL):
+	case NCT6795D_REG(NCT6795D_PARAMS_1):
+	case NCT6795D_REG(NCT6795D_PARAMS_2):
+	case NCT6795D_REG_LD09_ENABLE:
+		return true;
+	default:
+		return false;
+	}
 }
 
-/* End adapted from drivers/hwmon/nct6775.c */
+/*
+ * The enable registers also hold bits we do not control, so they are always
+ * read from the hardware.
+ */
+static bool nct6795d_regmap_volatile(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case NCT6795D_REG(NCT6795D_RGB_ENABLE):
+	case NCT6795D_REG_LD09_ENABLE:
+		return true;
+	default:
+		return false;
+	}
+}
 
-#define NCT6795D_DEVICE_NAME "nct6795d"
-#define DEFAULT_STEP_DURATION 25
+static const struct regmap_config nct6795d_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = NCT6795D_MAX_REG,
+	.readable_reg = nct6795d_regmap_accessible,
+	.writeable_reg = nct6795d_regmap_accessible,
+	.volatile_reg = nct6795d_regmap_volatile,
+	.cache_type = REGCACHE_FLAT,
+};
 
-#define NCT6795D_RGB_BANK 0x12
-
-/* Color registers */
-#define NCT6795D_RED_CELL 0xf0
-#define NCT6795D_GREEN_CELL 0xf4
-#define NCT6795D_BLUE_CELL 0xf8
-
-#define NCT6795D_PARAMS_0 0xe4
-/* Enable/disable LED overall */
-#define PARAMS_0_LED_ENABLE(e) ((e) ? 0x0 : 0x1)
-/* Enable/disable smooth pulsing */
-#define PARAMS_0_LED_PULSE_ENABLE(e) ((e) ? 0x08 : 0x0)
-/* Duration between blinks (0 means always on) */
-#define PARAMS_0_BLINK_DURATION(x) ((x) & 0x07)
-
-#define NCT6795D_PARAMS_1 0xfe
-/* Lower part of step duration (8 out of 9 bits) */
-#define PARAMS_1_STEP_DURATION_LOW(s) ((s) & 0xff)
-
-#define NCT6795D_PARAMS_2 0xff
-/* Enable fade-in effect for specified primitive */
-#define PARAMS_2_FADE_COLOR(r, g, b)                                           \
-	(0xe0 ^ (((r) ? 0x80 : 0x0) | ((g) ? 0x40 : 0x0) | ((b) ? 0x20 : 0x0)))
-/* Whether the specified colors should be inverted */
-#define PARAMS_2_INVERT_COLOR(r, g, b)                                         \
-	(((r) ? 0x10 : 0x0) | ((g) ? 0x08 : 0x0) | ((b) ? 0x04 : 0x0))
-/* Disable board leds if the LED_DISABLE bit is set */
-#define PARAMS_2_DISABLE_BOARD_LED 0x02
-/* MSB (9th bit) of step duration */
-#define PARAMS_2_STEP_DURATION_HIGH(s) (((s) >> 8) & 0x01)
-
-enum { RED = 0, GREEN, BLUE, NUM_COLORS };
-
-struct nct6795d_led {
-	struct device *dev;
-	u16 base_port;
-	struct led_classdev_mc mc_cdev;
-	struct mc_subled subled[NUM_COLORS];
+static const char * const nct6795d_op_names[] = {
+	[NCT6795D_OP_PROBE] = "probe",
+	[NCT6795D_OP_PROBE_ADOPT] = "probe_adopt",
+	[NCT6795D_OP_SETUP] = "setup",
+	[NCT6795D_OP_COMMIT_NOOP] = "commit_noop",
+	[NCT6795D_OP_COMMIT_SINGLE] = "commit_single",
+	[NCT6795D_OP_COMMIT_FULL] = "commit_full",
+	[NCT6795D_OP_RESUME] = "resume",
 };
 
-#define NCTLEDS_CHIP_NCT6795D 0
-#define NCTLEDS_CHIP_NCT6797D 1
+/*
+ * Maximum port I/O of each operation. These assume the worst case, i.e. that
+ * the session is closed when the operation starts and at its end. Entering
+ * costs 2 writes, exiting 3, selecting a logical device 2, writing a register
+ * 2 and reading one 1 write and 1 read.
+ *
+ * These are ceilings, only used to warn about regressions at runtime. The exact
+ * cost of each operation is checked by the KUnit suite of the test module.
+ */
+static const struct nct6795d_io_count nct6795d_io_budgets[] = {
+	/*
+	 * Setup, then forced commit of all parameters and color registers in
+	 * the same session
+	 */
+	[NCT6795D_OP_PROBE] = { .reads = 2, .writes = 45, .sessions = 1 },
+	/*
+	 * Same, but the parameters and color registers are read first and only
+	 * those which differ are written
+	 */
+	[NCT6795D_OP_PROBE_ADOPT] = { .reads = 17,
+				      .writes = 60,
+				      .sessions = 1 },
+	/* Read-modify-write of the two enable registers */
+	[NCT6795D_OP_SETUP] = { .reads = 2, .writes = 15, .sessions = 1 },
+	/* Nothing changed, the Super I/O is not accessed */
+	[NCT6795D_OP_COMMIT_NOOP] = { .reads = 0, .writes = 0, .sessions = 0 },
+	/* A single color cell or parameter changed */
+	[NCT6795D_OP_COMMIT_SINGLE] = { .reads = 0,
+					.writes = 15,
+					.sessions = 1 },
+	/* Any other change, up to all parameters and color registers */
+	[NCT6795D_OP_COMMIT_FULL] = { .reads = 0, .writes = 37, .sessions = 1 },
+	/*
+	 * Setup, read back of the parameters and color registers and rewrite
+	 * of those which differ from the cache
+	 */
+	[NCT6795D_OP_RESUME] = { .reads = 17, .writes = 60, .sessions = 1 },
+};
+
+static struct nct6795d_led *cdev_to_nct6795d_led(struct led_classdev *cdev)
+{
+	return container_of(lcdev_to_mccdev(cdev), struct nct6795d_led,
+			    mc_cdev);
+}
 
 static const char * const chip_names[] = {
 	"NCT6795D",
@@ -141,17 +316,23 @@ static const char * const chip_names[] = {
  * Return the detected chip (NCTLEDS_CHIP_*), or -ENODEV if no chip could be
  * detected.
  */
-static int nct6795d_led_detect(u16 base_port)
+static int nct6795d_led_detect(struct nct6795d_io *io, u16 base_port)
 {
+	struct nct6795d_sio_client *client;
 	int ret;
 	u16 val;
 
-	ret = superio_enter(base_port);
+	client = nct6795d_sio_client_get(io, base_port, "detect");
+	if (IS_ERR(client))
+		return PTR_ERR(client);
+
+	ret = nct6795d_sio_begin(client);
 	if (ret)
-		return ret;
+		goto out;
 
-	val = (superio_inb(base_port, SIO_REG_DEVID) << 8) |
-	      superio_inb(base_port, SIO_REG_DEVID + 1);
+	val = (nct6795d_sio_inb(client, SIO_REG_DEVID) << 8) |
+	      nct6795d_sio_inb(client, SIO_REG_DEVID + 1);
+	nct6795d_sio_end(client);
 
 	switch (val & 0xfff0) {
 	case 0xd350:
@@ -165,154 +346,1238 @@ static int nct6795d_led_detect(u16 base_port)
 		break;
 	}
 
-	superio_exit(base_port);
+out:
+	/* Also leaves the configuration mode, the session having no client */
+	nct6795d_sio_client_put(client);
 	return ret;
 }
 
 /*
- * Setup the LEDs for use with the LED interface. I.e, no pulsing or other fancy
- * features, only static colors.
+ * Start counting the port I/O of an operation. Return whether budget checks
+ * are enabled, in which case nct6795d_led_io_end() must be called at the end
+ * of the operation.
+ */
+static bool nct6795d_led_io_begin(struct nct6795d_led *led,
+				  struct nct6795d_io_count *start)
+{
+	if (!nct6795d_verify_on())
+		return false;
+
+	nct6795d_sio_io_count(led->client, start);
+
+	return true;
+}
+
+/*
+ * Record the port I/O performed by op since nct6795d_led_io_begin(), and warn
+ * if it exceeds its budget.
  */
-static int nct6795d_led_setup(const struct nct6795d_led *led)
+static void nct6795d_led_io_end(struct nct6795d_led *led, enum nct6795d_op op,
+				const struct nct6795d_io_count *start)
 {
+	const struct nct6795d_io_count *budget = &nct6795d_io_budgets[op];
+	struct nct6795d_io_count *last = &led->io_last[op];
+	struct nct6795d_io_count end;
+
+	nct6795d_sio_io_count(led->client, &end);
+	last->reads = end.reads - start->reads;
+	last->writes = end.writes - start->writes;
+	last->sessions = end.sessions - start->sessions;
+
+	if (last->reads > budget->reads || last->writes > budget->writes ||
+	    last->sessions > budget->sessions)
+		dev_warn_ratelimited(led->dev,
+				     "%s over port I/O budget: expected reads/writes/sessions %llu/%llu/%llu, got %llu/%llu/%llu\n",
+				     nct6795d_op_names[op], budget->reads,
+				     budget->writes, budget->sessions,
+				     last->reads, last->writes, last->sessions);
+}
+
+/*
+ * Setup the LEDs for use with the LED interface, by enabling the RGB control
+ * of the chip. The parameters are set by nct6795d_led_commit().
+ */
+VISIBLE_IF_NCT6795D_TESTS int nct6795d_led_setup(struct nct6795d_led *led)
+{
+	struct nct6795d_io_count io_start;
+	bool checked;
+	ktime_t start = 0;
 	int ret;
-	u16 val;
 
-	ret = superio_enter(led->base_port);
-	if (ret)
-		return ret;
+	if (trace_nct6795d_led_setup_enabled())
+		start = ktime_get();
 
-	/* Without this pulsing does not work? */
-	superio_select(led->base_port, 0x09);
-	val = superio_inb(led->base_port, 0x2c);
-	if ((val & 0x10) != 0x10)
-		superio_outb(led->base_port, 0x2c, val | 0x10);
+	checked = nct6795d_led_io_begin(led, &io_start);
+	nct6795d_sio_get(led->client);
 
-	superio_select(led->base_port, NCT6795D_RGB_BANK);
+	/* Without this pulsing does not work? */
+	ret = regmap_update_bits(led->regmap, NCT6795D_REG_LD09_ENABLE, 0x10,
+				 0x10);
+	if (ret)
+		goto out;
 
 	/* Enable RGB control */
-	val = superio_inb(led->base_port, 0xe0);
-	superio_outb(led->base_port, 0xe0, val | 0xe0);
+	ret = regmap_update_bits(led->regmap, NCT6795D_REG(NCT6795D_RGB_ENABLE),
+				 0xe0, 0xe0);
+
+out:
+	nct6795d_sio_put(led->client);
+	if (checked)
+		nct6795d_led_io_end(led, NCT6795D_OP_SETUP, &io_start);
+	if (start)
+		trace_nct6795d_led_setup(ktime_ns_delta(ktime_get(), start),
+					 ret);
+	return ret;
+}
+EXPORT_SYMBOL_IF_NCT6795D_TESTS(nct6795d_led_setup);
 
-	/*
-	 * Set some static parameters: led enabled, no pulse, no blink,
-	 * default step duration, no fading, no inversion. These fancy features
-	 * are not supported by the LED API at the moment.
-	 */
-	superio_outb(led->base_port, NCT6795D_PARAMS_0,
-		     PARAMS_0_LED_ENABLE(true) |
-			     PARAMS_0_LED_PULSE_ENABLE(false) |
-			     PARAMS_0_BLINK_DURATION(0));
+/*
+ * Compute the values of the registers of one color cell. Each register holds
+ * the 4-bit intensities of two consecutive time frames, the first one in the
+ * upper nibble.
+ */
+static void nct6795d_led_fill_cell(u8 *cell, const u8 *frames)
+{
+	int i;
 
-	superio_outb(led->base_port, NCT6795D_PARAMS_1,
-		     PARAMS_1_STEP_DURATION_LOW(DEFAULT_STEP_DURATION));
+	for (i = 0; i < NCT6795D_CELL_SIZE; i++)
+		cell[i] = (frames[2 * i] << 4) | frames[2 * i + 1];
+}
 
-	superio_outb(led->base_port, NCT6795D_PARAMS_2,
-		     PARAMS_2_FADE_COLOR(false, false, false) |
-			PARAMS_2_INVERT_COLOR(false, false, false) |
-			PARAMS_2_DISABLE_BOARD_LED |
-			PARAMS_2_STEP_DURATION_HIGH(DEFAULT_STEP_DURATION));
+/*
+ * Registers holding the state of the LED, in this order: PARAMS_0, the color
+ * cells, PARAMS_1 and PARAMS_2.
+ */
+#define NCT6795D_BANK_PARAMS_0 0
+#define NCT6795D_BANK_CELLS 1
+#define NCT6795D_BANK_PARAMS_1 (NCT6795D_BANK_CELLS + NCT6795D_NUM_CELLS)
+#define NCT6795D_BANK_PARAMS_2 (NCT6795D_BANK_PARAMS_1 + 1)
+#define NCT6795D_BANK_SIZE (NCT6795D_BANK_PARAMS_2 + 1)
 
-	superio_exit(led->base_port);
-	return 0;
+static unsigned int nct6795d_bank_reg(int i)
+{
+	if (i == NCT6795D_BANK_PARAMS_0)
+		return NCT6795D_REG(NCT6795D_PARAMS_0);
+	else if (i < NCT6795D_BANK_PARAMS_1)
+		return NCT6795D_REG(NCT6795D_RED_CELL) + i -
+		       NCT6795D_BANK_CELLS;
+	else
+		return NCT6795D_REG(NCT6795D_PARAMS_1) + i -
+		       NCT6795D_BANK_PARAMS_1;
 }
 
 /*
- * Commit one color to the hardware.
+ * Read the state registers, from the cache or from the hardware if the cache
+ * is bypassed.
  */
-static void nct6795d_led_commit_color(const struct nct6795d_led *led,
-				      size_t color_cell,
-				      enum led_brightness brightness)
+static int nct6795d_led_read_bank(struct nct6795d_led *led, u8 *bank)
 {
+	unsigned int val;
+	int ret;
 	int i;
-	/*
-	 * These 8 4-bit nibbles represent brightness intensity for each time
-	 * frame. We set them all to the same value to get a constant color.
-	 */
-	const u8 b = (brightness << 4) | brightness;
 
-	for (i = 0; i < 4; i++)
-		superio_outb(led->base_port, color_cell + i, b);
+	for (i = 0; i < NCT6795D_BANK_SIZE; i++) {
+		ret = regmap_read(led->regmap, nct6795d_bank_reg(i), &val);
+		if (ret)
+			return ret;
+		bank[i] = val;
+	}
+
+	return 0;
 }
 
 /*
- * Commit all colors to the hardware.
+ * Adopt the state programmed by the firmware. The parameters and color
+ * registers are read once from the hardware and seeded into the register
+ * cache, and into the LED state if seed_state is set, so the next commit only
+ * writes those which differ. seed_state also seeds the brightness of the LED
+ * class device, and must only be set before it is registered.
  */
-static int nct6795d_led_commit(const struct nct6795d_led *led)
+static int nct6795d_led_adopt(struct nct6795d_led *led, bool seed_state)
 {
-	const struct mc_subled *subled = led->subled;
+	struct led_classdev *cdev = &led->mc_cdev.led_cdev;
+	struct nct6795d_led_state *state = &led->state;
+	u8 bank[NCT6795D_BANK_SIZE];
+	const u8 *cells = &bank[NCT6795D_BANK_CELLS];
+	u8 params_0, params_1, params_2;
+	unsigned long flags;
 	int ret;
+	int i, j;
 
-	dev_dbg(led->dev, "setting values: R=%d G=%d B=%d\n",
-		subled[RED].brightness, subled[GREEN].brightness,
-		subled[BLUE].brightness);
+	lockdep_assert_held(&led->io_lock);
 
-	ret = superio_enter(led->base_port);
+	regcache_cache_bypass(led->regmap, true);
+	ret = nct6795d_led_read_bank(led, bank);
+	regcache_cache_bypass(led->regmap, false);
 	if (ret)
 		return ret;
 
-	superio_select(led->base_port, NCT6795D_RGB_BANK);
+	regcache_cache_only(led->regmap, true);
+	for (i = 0; i < NCT6795D_BANK_SIZE && !ret; i++)
+		ret = regmap_write(led->regmap, nct6795d_bank_reg(i), bank[i]);
+	regcache_cache_only(led->regmap, false);
+	if (ret || !seed_state)
+		return ret;
+
+	params_0 = bank[NCT6795D_BANK_PARAMS_0];
+	params_1 = bank[NCT6795D_BANK_PARAMS_1];
+	params_2 = bank[NCT6795D_BANK_PARAMS_2];
 
-	nct6795d_led_commit_color(led, NCT6795D_RED_CELL,
-				  subled[RED].brightness);
-	nct6795d_led_commit_color(led, NCT6795D_GREEN_CELL,
-				  subled[GREEN].brightness);
-	nct6795d_led_commit_color(led, NCT6795D_BLUE_CELL,
-				  subled[BLUE].brightness);
+	spin_lock_irqsave(&led->lock, flags);
+
+	for (i = 0; i < NUM_COLORS; i++) {
+		for (j = 0; j < NCT6795D_CELL_SIZE; j++) {
+			u8 val = cells[i * NCT6795D_CELL_SIZE + j];
+
+			state->frames[i][2 * j] = val >> 4;
+			state->frames[i][2 * j + 1] = val & 0xf;
+		}
+		led->subled[i].intensity = state->frames[i][0];
+		/* As led_mc_calc_color_components() at full brightness */
+		led->subled[i].brightness = state->frames[i][0];
+	}
+
+	state->enable = !(params_0 & PARAMS_0_LED_ENABLE(false));
+	state->blink = params_0 & PARAMS_0_BLINK_DURATION(0xff);
+	state->pulse = params_0 & PARAMS_0_LED_PULSE_ENABLE(true);
+	/* The 9th bit of the step duration is the LSB of PARAMS_2 */
+	state->step_duration = params_1 | (params_2 & 0x01) << 8;
+	/* Fading is enabled when the bit of the color is cleared */
+	state->fade[RED] = !(params_2 & 0x80);
+	state->fade[GREEN] = !(params_2 & 0x40);
+	state->fade[BLUE] = !(params_2 & 0x20);
+	state->invert[RED] = params_2 & 0x10;
+	state->invert[GREEN] = params_2 & 0x08;
+	state->invert[BLUE] = params_2 & 0x04;
+	state->disable_board_led = params_2 & PARAMS_2_DISABLE_BOARD_LED;
+
+	if (state->step_duration)
+		led->step_duration = state->step_duration;
+	led->pattern = false;
+	cdev->brightness = cdev->max_brightness;
+
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	dev_dbg(led->dev, "adopted firmware color: R=%d G=%d B=%d\n",
+		state->frames[RED][0], state->frames[GREEN][0],
+		state->frames[BLUE][0]);
 
-	superio_exit(led->base_port);
 	return 0;
 }
 
+/*
+ * Write count (up to NCT6795D_CELL_SIZE) consecutive registers starting at
+ * reg. Unless force is set, registers which already hold the requested value
+ * according to the regmap cache are skipped. If yield is set, the Super I/O
+ * session is yielded before the first register written, if any.
+ *
+ * Return the number of registers written, or a negative error code.
+ */
+static int nct6795d_led_write(struct nct6795d_led *led, unsigned int reg,
+			      const u8 *val, size_t count, bool force,
+			      bool yield)
+{
+	u8 cur[NCT6795D_CELL_SIZE];
+	int written = 0;
+	size_t i;
+	int ret;
+
+	if (!force) {
+		/* Served from the cache, no hardware access */
+		ret = regmap_bulk_read(led->regmap, reg, cur, count);
+		if (ret)
+			return ret;
+	}
+
+	/* The bus accesses one register at a time anyway */
+	for (i = 0; i < count; i++) {
+		if (!force && cur[i] == val[i]) {
+			led->skipped_writes++;
+			continue;
+		}
+
+		if (yield && !written)
+			nct6795d_sio_yield(led->client);
+
+		ret = regmap_write(led->regmap, reg + i, val[i]);
+		if (ret)
+			return ret;
+		written++;
+	}
+
+	return written;
+}
+
+/*
+ * Commit the last requested state to the hardware.
+ *
+ * Unless force is set or the previous commit failed, only the registers which
+ * value differs from the regmap cache are written, and the Super I/O is not
+ * accessed at all if nothing changed.
+ */
+VISIBLE_IF_NCT6795D_TESTS int
+nct6795d_led_commit(struct nct6795d_led *led, bool force)
+{
+	u8 cells[NUM_COLORS][NCT6795D_CELL_SIZE];
+	struct nct6795d_io_count io_start;
+	bool checked;
+	struct nct6795d_led_state state;
+	u8 params_0, params_1, params_2;
+	ktime_t request_time;
+	enum nct6795d_op op;
+	unsigned long flags;
+	unsigned int reg;
+	int written = 0;
+	int ret;
+	int i;
+
+	lockdep_assert_held(&led->io_lock);
+
+	/* The cache cannot be trusted after a failure, rewrite everything */
+	force |= led->commit_failed;
+
+	spin_lock_irqsave(&led->lock, flags);
+	state = led->state;
+	request_time = led->request_time;
+	led->request_time = 0;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	dev_dbg(led->dev,
+		"setting values: R=%d G=%d B=%d, step duration %d, blink %d, pulse %d\n",
+		state.frames[RED][0], state.frames[GREEN][0],
+		state.frames[BLUE][0], state.step_duration, state.blink,
+		state.pulse);
+	trace_nct6795d_led_commit_start(state.frames[RED][0],
+					state.frames[GREEN][0],
+					state.frames[BLUE][0]);
+
+	params_0 = PARAMS_0_LED_ENABLE(state.enable) |
+		   PARAMS_0_LED_PULSE_ENABLE(state.pulse) |
+		   PARAMS_0_BLINK_DURATION(state.blink);
+	params_1 = PARAMS_1_STEP_DURATION_LOW(state.step_duration);
+	params_2 = PARAMS_2_FADE_COLOR(state.fade[RED], state.fade[GREEN],
+				       state.fade[BLUE]) |
+		   PARAMS_2_INVERT_COLOR(state.invert[RED],
+					 state.invert[GREEN],
+					 state.invert[BLUE]) |
+		   (state.disable_board_led ? PARAMS_2_DISABLE_BOARD_LED : 0) |
+		   PARAMS_2_STEP_DURATION_HIGH(state.step_duration);
+
+	for (i = 0; i < NUM_COLORS; i++)
+		nct6795d_led_fill_cell(cells[i], state.frames[i]);
+
+	checked = nct6795d_led_io_begin(led, &io_start);
+	nct6795d_sio_get(led->client);
+
+	ret = nct6795d_led_write(led, NCT6795D_REG(NCT6795D_PARAMS_0),
+				 &params_0, 1, force, false);
+	if (ret < 0)
+		goto out;
+	written += ret;
+
+	ret = nct6795d_led_write(led, NCT6795D_REG(NCT6795D_PARAMS_1),
+				 &params_1, 1, force, false);
+	if (ret < 0)
+		goto out;
+	written += ret;
+
+	ret = nct6795d_led_write(led, NCT6795D_REG(NCT6795D_PARAMS_2),
+				 &params_2, 1, force, false);
+	if (ret < 0)
+		goto out;
+	written += ret;
+
+	for (i = 0; i < NUM_COLORS; i++) {
+		/* Yield between the written cells, the chunks of a commit */
+		reg = NCT6795D_REG(NCT6795D_RED_CELL + i * NCT6795D_CELL_SIZE);
+		ret = nct6795d_led_write(led, reg, cells[i], NCT6795D_CELL_SIZE,
+					 force, written > 0);
+		if (ret < 0)
+			goto out;
+		written += ret;
+	}
+
+	ret = 0;
+
+out:
+	nct6795d_sio_put(led->client);
+	led->commit_failed = ret != 0;
+
+	if (checked) {
+		if (written == 0)
+			op = NCT6795D_OP_COMMIT_NOOP;
+		else if (written <= NCT6795D_CELL_SIZE)
+			op = NCT6795D_OP_COMMIT_SINGLE;
+		else
+			op = NCT6795D_OP_COMMIT_FULL;
+		nct6795d_led_io_end(led, op, &io_start);
+	}
+
+	if (nct6795d_stats_on()) {
+		atomic64_inc(&led->stats.commits);
+		if (ret)
+			atomic64_inc(&led->stats.errors);
+		else if (request_time)
+			nct6795d_hist_add(&led->stats.latency,
+					  ktime_to_ns(ktime_get()) -
+					  ktime_to_ns(request_time));
+	}
+
+	trace_nct6795d_led_commit_end(state.frames[RED][0],
+				      state.frames[GREEN][0],
+				      state.frames[BLUE][0], written, ret);
+
+	return ret;
+}
+EXPORT_SYMBOL_IF_NCT6795D_TESTS(nct6795d_led_commit);
+
+/*
+ * Setup the chip and commit the requested state in a single session. At probe,
+ * the state set by the firmware is adopted if requested. Later, i.e. with
+ * lazy_setup, the requested state takes precedence over it.
+ */
+VISIBLE_IF_NCT6795D_TESTS int
+nct6795d_led_bringup(struct nct6795d_led *led, bool probing)
+{
+	struct nct6795d_io_count io_start;
+	bool checked;
+	int ret;
+
+	lockdep_assert_held(&led->io_lock);
+
+	checked = nct6795d_led_io_begin(led, &io_start);
+	nct6795d_sio_get(led->client);
+
+	ret = nct6795d_led_setup(led);
+	if (ret)
+		goto out;
+
+	if (led->adopt) {
+		ret = nct6795d_led_adopt(led, probing);
+		if (ret)
+			goto out;
+	}
+
+	/* When adopting, the cache is populated and matching writes skipped */
+	ret = nct6795d_led_commit(led, !led->adopt);
+	if (!ret)
+		led->setup_done = true;
+
+out:
+	nct6795d_sio_put(led->client);
+	if (checked)
+		nct6795d_led_io_end(led, led->adopt ? NCT6795D_OP_PROBE_ADOPT :
+						      NCT6795D_OP_PROBE,
+				    &io_start);
+
+	return ret;
+}
+EXPORT_SYMBOL_IF_NCT6795D_TESTS(nct6795d_led_bringup);
+
+/* Bounds of the delay between retries of a commit */
+#define NCT6795D_RETRY_MIN_MS 1
+#define NCT6795D_RETRY_MAX_MS 1000
+
+static void nct6795d_led_commit_work(struct work_struct *work)
+{
+	struct nct6795d_led *led = container_of(to_delayed_work(work),
+						struct nct6795d_led,
+						commit_work);
+	int ret;
+
+	mutex_lock(&led->io_lock);
+	if (likely(led->setup_done))
+		ret = nct6795d_led_commit(led, false);
+	else
+		ret = nct6795d_led_bringup(led, false);
+	if (ret == -EBUSY) {
+		/*
+		 * Another driver holds the Super I/O, retry with an exponential
+		 * backoff so the last requested state eventually lands.
+		 */
+		led->retry_delay_ms = clamp(led->retry_delay_ms * 2,
+					    NCT6795D_RETRY_MIN_MS,
+					    NCT6795D_RETRY_MAX_MS);
+		led->retries++;
+		queue_delayed_work(system_wq, &led->commit_work,
+				   msecs_to_jiffies(led->retry_delay_ms));
+	} else {
+		led->retry_delay_ms = 0;
+	}
+	mutex_unlock(&led->io_lock);
+
+	if (ret == -EBUSY)
+		dev_dbg(led->dev, "Super I/O busy, retrying in %u ms\n",
+			led->retry_delay_ms);
+	else if (ret)
+		dev_err_ratelimited(led->dev, "failed to commit state: %d\n",
+				    ret);
+}
+
+/*
+ * Schedule the commit of the last requested state. Requests received before
+ * the commit work runs are coalesced, and only the last one reaches the
+ * hardware.
+ */
+static void nct6795d_led_schedule_commit(struct nct6795d_led *led)
+{
+	unsigned long flags;
+	bool queued;
+
+	if (nct6795d_stats_on()) {
+		spin_lock_irqsave(&led->lock, flags);
+		if (!led->request_time)
+			led->request_time = ktime_get();
+		spin_unlock_irqrestore(&led->lock, flags);
+	}
+
+	/* Does nothing if a commit is already pending */
+	queued = queue_delayed_work(system_wq, &led->commit_work,
+				    msecs_to_jiffies(commit_delay_ms));
+
+	if (nct6795d_stats_on()) {
+		atomic64_inc(&led->stats.requests);
+		if (!queued)
+			atomic64_inc(&led->stats.coalesced);
+	}
+}
+
+/*
+ * Set a static color for the given brightness. Must be called with the state
+ * lock held.
+ */
+static void nct6795d_led_set_static(struct nct6795d_led *led,
+				    enum led_brightness brightness)
+{
+	int i;
+
+	lockdep_assert_held(&led->lock);
+
+	led_mc_calc_color_components(&led->mc_cdev, brightness);
+	for (i = 0; i < NUM_COLORS; i++)
+		memset(led->state.frames[i], led->subled[i].brightness,
+		       NCT6795D_NUM_FRAMES);
+	led->state.step_duration = led->step_duration;
+	led->state.enable = true;
+	led->pattern = false;
+}
+
 /*
  * led_classdev's brightness_set hook.
+ *
+ * This only records the requested color and schedules its commit, so it can
+ * be called from any context. Any hardware pattern is replaced by a static
+ * color, and turning the LED off also stops hardware blinking.
  */
 static void nct6795d_led_brightness_set(struct led_classdev *cdev,
 					enum led_brightness brightness)
 {
-	struct led_classdev_mc *mc_cdev = lcdev_to_mccdev(cdev);
-	struct nct6795d_led *led =
-		container_of(mc_cdev, struct nct6795d_led, mc_cdev);
+	struct nct6795d_led *led = cdev_to_nct6795d_led(cdev);
+	unsigned long flags;
+
+	spin_lock_irqsave(&led->lock, flags);
+	nct6795d_led_set_static(led, brightness);
+	if (brightness == LED_OFF)
+		led->state.blink = 0;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_led_schedule_commit(led);
+}
+
+/*
+ * led_classdev's blink_set hook.
+ *
+ * The hardware only supports a few symmetric blink periods. Requests that
+ * cannot be approximated by one of them within 25% are rejected so the LED
+ * core falls back to software blinking.
+ */
+static int nct6795d_led_blink_set(struct led_classdev *cdev,
+				  unsigned long *delay_on,
+				  unsigned long *delay_off)
+{
+	struct nct6795d_led *led = cdev_to_nct6795d_led(cdev);
+	enum led_brightness brightness;
+	unsigned long period, error;
+	unsigned long flags;
+	int best = 0;
+	int i;
+
+	if (*delay_on == 0 && *delay_off == 0) {
+		best = NCT6795D_DEFAULT_BLINK;
+	} else {
+		period = *delay_on + *delay_off;
+		if (abs((long)*delay_on - (long)*delay_off) > period / 4)
+			return -EINVAL;
+
+		error = ULONG_MAX;
+		for (i = 1; i < ARRAY_SIZE(nct6795d_blink_periods); i++) {
+			unsigned long p = nct6795d_blink_periods[i];
+			unsigned long e = p > period ? p - period : period - p;
+
+			if (e < error) {
+				error = e;
+				best = i;
+			}
+		}
+
+		if (error > period / 4)
+			return -EINVAL;
+	}
+
+	*delay_on = nct6795d_blink_periods[best] / 2;
+	*delay_off = nct6795d_blink_periods[best] / 2;
+
+	/* Blink with the full brightness if the LED is currently off */
+	brightness = cdev->brightness ?: cdev->max_brightness;
+
+	spin_lock_irqsave(&led->lock, flags);
+	nct6795d_led_set_static(led, brightness);
+	led->state.blink = best;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_led_schedule_commit(led);
+
+	return 0;
+}
+
+/*
+ * led_classdev's pattern_set hook.
+ *
+ * The pattern is played by the hardware, which has NCT6795D_NUM_FRAMES time
+ * frames and repeats them indefinitely. Patterns which length divides the
+ * number of frames are supported, and repeated to fill all of them. The
+ * brightness of each step is applied to the multicolor intensities. All steps
+ * must have the same delta_t, which is the hardware step duration (1 to 511)
+ * rather than a time in milliseconds.
+ */
+static int nct6795d_led_pattern_set(struct led_classdev *cdev,
+				    struct led_pattern *pattern, u32 len,
+				    int repeat)
+{
+	struct nct6795d_led *led = cdev_to_nct6795d_led(cdev);
+	unsigned long flags;
+	int brightness;
+	int i, j;
+
+	if (repeat != -1 || len == 0 || len > NCT6795D_NUM_FRAMES ||
+	    NCT6795D_NUM_FRAMES % len)
+		return -EINVAL;
+
+	if (pattern[0].delta_t == 0 ||
+	    pattern[0].delta_t > NCT6795D_MAX_STEP_DURATION)
+		return -EINVAL;
+
+	for (i = 0; i < len; i++) {
+		if (pattern[i].delta_t != pattern[0].delta_t ||
+		    pattern[i].brightness < 0 ||
+		    pattern[i].brightness > cdev->max_brightness)
+			return -EINVAL;
+	}
+
+	spin_lock_irqsave(&led->lock, flags);
+	led->state.blink = 0;
+	for (i = 0; i < NCT6795D_NUM_FRAMES; i++) {
+		brightness = pattern[i % len].brightness;
+		for (j = 0; j < NUM_COLORS; j++)
+			led->state.frames[j][i] = led->subled[j].intensity *
+						  brightness /
+						  cdev->max_brightness;
+	}
+	led->state.step_duration = pattern[0].delta_t;
+	led->state.enable = true;
+	led->pattern = true;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_led_schedule_commit(led);
+
+	return 0;
+}
+
+/*
+ * led_classdev's pattern_clear hook.
+ */
+static int nct6795d_led_pattern_clear(struct led_classdev *cdev)
+{
+	nct6795d_led_brightness_set(cdev, cdev->brightness);
+
+	return 0;
+}
+
+static ssize_t pulse_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct nct6795d_led *led = cdev_to_nct6795d_led(dev_get_drvdata(dev));
+
+	return sysfs_emit(buf, "%d\n", led->state.pulse);
+}
+
+static ssize_t pulse_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t size)
+{
+	struct led_classdev *cdev = dev_get_drvdata(dev);
+	struct nct6795d_led *led = cdev_to_nct6795d_led(cdev);
+	unsigned long flags;
+	bool pulse;
+	int ret;
+
+	ret = kstrtobool(buf, &pulse);
+	if (ret)
+		return ret;
+
+	mutex_lock(&cdev->led_access);
+
+	if (led_sysfs_is_disabled(cdev)) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	spin_lock_irqsave(&led->lock, flags);
+	led->state.pulse = pulse;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_led_schedule_commit(led);
+	ret = size;
+
+unlock:
+	mutex_unlock(&cdev->led_access);
+	return ret;
+}
+static DEVICE_ATTR_RW(pulse);
+
+static ssize_t step_duration_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct nct6795d_led *led = cdev_to_nct6795d_led(dev_get_drvdata(dev));
+
+	return sysfs_emit(buf, "%u\n", led->step_duration);
+}
+
+static ssize_t step_duration_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t size)
+{
+	struct led_classdev *cdev = dev_get_drvdata(dev);
+	struct nct6795d_led *led = cdev_to_nct6795d_led(cdev);
+	unsigned long flags;
+	u16 step_duration;
+	int ret;
+
+	ret = kstrtou16(buf, 0, &step_duration);
+	if (ret)
+		return ret;
+
+	if (step_duration > NCT6795D_MAX_STEP_DURATION)
+		return -EINVAL;
+
+	mutex_lock(&cdev->led_access);
+
+	if (led_sysfs_is_disabled(cdev)) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	spin_lock_irqsave(&led->lock, flags);
+	led->step_duration = step_duration;
+	/* Patterns have their own step duration */
+	if (!led->pattern)
+		led->state.step_duration = step_duration;
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_led_schedule_commit(led);
+	ret = size;
+
+unlock:
+	mutex_unlock(&cdev->led_access);
+	return ret;
+}
+static DEVICE_ATTR_RW(step_duration);
+
+static ssize_t fade_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct nct6795d_led *led = cdev_to_nct6795d_led(dev_get_drvdata(dev));
+
+	return sysfs_emit(buf, "%d %d %d\n", led->state.fade[RED],
+			  led->state.fade[GREEN], led->state.fade[BLUE]);
+}
+
+/*
+ * Takes one boolean per color, in the same order as multi_index.
+ */
+static ssize_t fade_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t size)
+{
+	struct led_classdev *cdev = dev_get_drvdata(dev);
+	struct nct6795d_led *led = cdev_to_nct6795d_led(cdev);
+	unsigned int fade[NUM_COLORS];
+	unsigned long flags;
+	int ret;
+	int i;
+
+	if (sscanf(buf, "%u %u %u", &fade[RED], &fade[GREEN], &fade[BLUE]) !=
+	    NUM_COLORS)
+		return -EINVAL;
+
+	mutex_lock(&cdev->led_access);
+
+	if (led_sysfs_is_disabled(cdev)) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	spin_lock_irqsave(&led->lock, flags);
+	for (i = 0; i < NUM_COLORS; i++)
+		led->state.fade[i] = !!fade[i];
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	nct6795d_led_schedule_commit(led);
+	ret = size;
+
+unlock:
+	mutex_unlock(&cdev->led_access);
+	return ret;
+}
+static DEVICE_ATTR_RW(fade);
+
+static ssize_t rgb_show(struct device *dev, struct device_attribute *attr,
+			char *buf)
+{
+	struct nct6795d_led *led = cdev_to_nct6795d_led(dev_get_drvdata(dev));
+
+	return sysfs_emit(buf, "%u %u %u\n", led->subled[RED].brightness,
+			  led->subled[GREEN].brightness,
+			  led->subled[BLUE].brightness);
+}
+
+/*
+ * Parse either three intensities in the [0-max_brightness] range, or a hex
+ * triplet of 8-bit components with an optional leading '#', e.g. "#ff8000",
+ * which is scaled to the range of the intensities.
+ */
+static int nct6795d_led_parse_rgb(const struct led_classdev *cdev,
+				  const char *buf, unsigned int *rgb)
+{
+	unsigned int max = cdev->max_brightness;
+	unsigned int hex;
+	int i;
+
+	if (sscanf(buf, "%u %u %u", &rgb[RED], &rgb[GREEN], &rgb[BLUE]) ==
+	    NUM_COLORS) {
+		for (i = 0; i < NUM_COLORS; i++) {
+			if (rgb[i] > max)
+				return -EINVAL;
+		}
+
+		return 0;
+	}
+
+	if (buf[0] == '#')
+		buf++;
+	if (strcspn(buf, "\n") != 6 || kstrtouint(buf, 16, &hex))
+		return -EINVAL;
+
+	for (i = 0; i < NUM_COLORS; i++) {
+		u8 component = hex >> (8 * (NUM_COLORS - 1 - i));
+
+		rgb[i] = DIV_ROUND_CLOSEST(component * max, 0xff);
+	}
+
+	return 0;
+}
+
+/*
+ * Set the intensities of all colors and the maximum brightness at once, so the
+ * color changes in a single commit without going through intermediate colors.
+ */
+static ssize_t rgb_store(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t size)
+{
+	struct led_classdev *cdev = dev_get_drvdata(dev);
+	struct nct6795d_led *led = cdev_to_nct6795d_led(cdev);
+	unsigned int rgb[NUM_COLORS];
+	int ret;
+	int i;
+
+	ret = nct6795d_led_parse_rgb(cdev, buf, rgb);
+	if (ret)
+		return ret;
+
+	mutex_lock(&cdev->led_access);
+
+	/* Like brightness, refused while the LED core disables sysfs control */
+	if (led_sysfs_is_disabled(cdev)) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	for (i = 0; i < NUM_COLORS; i++)
+		led->subled[i].intensity = rgb[i];
+	led_set_brightness(cdev, cdev->max_brightness);
+	ret = size;
+
+unlock:
+	mutex_unlock(&cdev->led_access);
+	return ret;
+}
+static DEVICE_ATTR_RW(rgb);
+
+static struct attribute *nct6795d_led_attrs[] = {
+	&dev_attr_pulse.attr,
+	&dev_attr_step_duration.attr,
+	&dev_attr_fade.attr,
+	&dev_attr_rgb.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(nct6795d_led);
+
+static void nct6795d_led_client_put(void *data)
+{
+	nct6795d_sio_client_put(data);
+}
+
+static void nct6795d_led_cancel_work(void *data)
+{
+	struct nct6795d_led *led = data;
+
+	/* The restore work can queue the commit work */
+	cancel_work_sync(&led->restore_work);
+	/* Write the LED_OFF queued when the LED was unregistered */
+	flush_delayed_work(&led->commit_work);
+	/* Only a retry of a failed commit can be left, give up on it */
+	cancel_delayed_work_sync(&led->commit_work);
+	nct6795d_sio_flush(led->client);
+}
+
+static void nct6795d_led_debugfs_remove(void *data)
+{
+	struct nct6795d_led *led = data;
+
+	debugfs_remove_recursive(led->debugfs);
+}
+
+static int nct6795d_led_io_budget_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_led *led = s->private;
+	const struct nct6795d_io_count *budget, *last;
+	int i;
+
+	seq_puts(s, "# operation: budget, last (reads/writes/sessions)\n");
+	for (i = 0; i < NCT6795D_NUM_OPS; i++) {
+		budget = &nct6795d_io_budgets[i];
+		last = &led->io_last[i];
+		seq_printf(s, "%s: %llu/%llu/%llu, %llu/%llu/%llu\n",
+			   nct6795d_op_names[i], budget->reads, budget->writes,
+			   budget->sessions, last->reads, last->writes,
+			   last->sessions);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nct6795d_led_io_budget);
+
+static int nct6795d_led_stats_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_led *led = s->private;
+
+	seq_printf(s, "requests: %lld\n", atomic64_read(&led->stats.requests));
+	seq_printf(s, "coalesced: %lld\n",
+		   atomic64_read(&led->stats.coalesced));
+	seq_printf(s, "commits: %lld\n", atomic64_read(&led->stats.commits));
+	seq_printf(s, "commit_errors: %lld\n",
+		   atomic64_read(&led->stats.errors));
+	seq_printf(s, "skipped_writes: %llu\n", led->skipped_writes);
+	seq_printf(s, "retries: %llu\n", led->retries);
+
+	nct6795d_sio_stats_show(s, led->client);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nct6795d_led_stats);
+
+static int nct6795d_led_sio_clients_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_led *led = s->private;
+
+	nct6795d_sio_clients_show(s, led->client);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nct6795d_led_sio_clients);
+
+static int nct6795d_led_latency_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_led *led = s->private;
+
+	mutex_lock(&led->io_lock);
+	nct6795d_hist_show(s, "request_latency", &led->stats.latency);
+	mutex_unlock(&led->io_lock);
+
+	nct6795d_sio_latency_show(s, led->client);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nct6795d_led_latency);
+
+static int nct6795d_led_timings_show(struct seq_file *s, void *data)
+{
+	struct nct6795d_led *led = s->private;
+
+	seq_printf(s, "probe_ns: %lld\n", led->probe_ns);
+	seq_printf(s, "resume_ns: %lld\n", led->resume_ns);
+	seq_printf(s, "restore_ns: %lld\n", led->restore_ns);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nct6795d_led_timings);
+
+/* Toggle the instrumentation static key passed as data */
+static int nct6795d_led_key_enable_get(void *data, u64 *val)
+{
+	struct static_key_false *key = data;
+
+	*val = static_key_enabled(key);
+
+	return 0;
+}
+
+static int nct6795d_led_key_enable_set(void *data, u64 val)
+{
+	struct static_key_false *key = data;
 
-	led_mc_calc_color_components(mc_cdev, brightness);
+	nct6795d_led_key_set(key, val);
 
-	nct6795d_led_commit(led);
+	return 0;
 }
+DEFINE_DEBUGFS_ATTRIBUTE(nct6795d_led_key_enable_fops,
+			 nct6795d_led_key_enable_get,
+			 nct6795d_led_key_enable_set, "%llu\n");
+
+static int nct6795d_led_debugfs_init(struct nct6795d_led *led)
+{
+	led->debugfs = debugfs_create_dir(dev_name(led->dev), NULL);
+	debugfs_create_u64("skipped_writes", 0444, led->debugfs,
+			   &led->skipped_writes);
+	debugfs_create_u64("retries", 0444, led->debugfs, &led->retries);
+
+	if (NCT6795D_INSTRUMENTATION) {
+		debugfs_create_file("io_budget", 0444, led->debugfs, led,
+				    &nct6795d_led_io_budget_fops);
+		debugfs_create_file("stats", 0444, led->debugfs, led,
+				    &nct6795d_led_stats_fops);
+		debugfs_create_file("latency", 0444, led->debugfs, led,
+				    &nct6795d_led_latency_fops);
+		debugfs_create_file("timings", 0444, led->debugfs, led,
+				    &nct6795d_led_timings_fops);
+		debugfs_create_file("sio_clients", 0444, led->debugfs, led,
+				    &nct6795d_led_sio_clients_fops);
+		debugfs_create_file_unsafe("stats_enable", 0644, led->debugfs,
+					   &nct6795d_stats_enabled,
+					   &nct6795d_led_key_enable_fops);
+		debugfs_create_file_unsafe("verify_enable", 0644,
+					   led->debugfs,
+					   &nct6795d_verify_enabled,
+					   &nct6795d_led_key_enable_fops);
+	}
+
+	return devm_add_action_or_reset(led->dev, nct6795d_led_debugfs_remove,
+					led);
+}
+
+/*
+ * Read back the state registers and rewrite those which differ from the cache.
+ * The chip often keeps its state across suspend, in which case nothing is
+ * written.
+ */
+static int nct6795d_led_restore_bank(struct nct6795d_led *led)
+{
+	u8 cached[NCT6795D_BANK_SIZE];
+	u8 hw[NCT6795D_BANK_SIZE];
+	bool boundary = false;
+	int written = 0;
+	int ret;
+	int i;
+
+	ret = nct6795d_led_read_bank(led, cached);
+	if (ret)
+		return ret;
+
+	regcache_cache_bypass(led->regmap, true);
+	ret = nct6795d_led_read_bank(led, hw);
+	regcache_cache_bypass(led->regmap, false);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < NCT6795D_BANK_SIZE; i++) {
+		if (i >= NCT6795D_BANK_CELLS &&
+		    (i - NCT6795D_BANK_CELLS) % NCT6795D_CELL_SIZE == 0)
+			boundary = true;
+
+		if (hw[i] == cached[i])
+			continue;
+
+		/* Yield between the written cells, the chunks of a restore */
+		if (boundary && written)
+			nct6795d_sio_yield(led->client);
+		boundary = false;
+
+		ret = regmap_write(led->regmap, nct6795d_bank_reg(i),
+				   cached[i]);
+		if (ret)
+			return ret;
+		written++;
+	}
+
+	return 0;
+}
+
+/*
+ * Restore the state of the chip after resume. Run from a workqueue, so the LED
+ * may come back slightly after the rest of the system.
+ */
+VISIBLE_IF_NCT6795D_TESTS void
+nct6795d_led_restore_work(struct work_struct *work)
+{
+	struct nct6795d_led *led = container_of(work, struct nct6795d_led,
+						restore_work);
+	struct nct6795d_io_count io_start;
+	bool checked;
+	ktime_t start = 0;
+	int ret;
+
+	if (nct6795d_timing_on() || trace_nct6795d_led_resume_enabled())
+		start = ktime_get();
+
+	checked = nct6795d_led_io_begin(led, &io_start);
+	mutex_lock(&led->io_lock);
+
+	/* With lazy_setup, the chip may not have been setup yet */
+	if (!led->setup_done) {
+		ret = 0;
+		goto out_unlock;
+	}
+
+	nct6795d_sio_get(led->client);
+
+	ret = nct6795d_led_setup(led);
+	if (ret)
+		goto out;
+
+	ret = nct6795d_led_restore_bank(led);
+
+out:
+	nct6795d_sio_put(led->client);
+out_unlock:
+	/* On failure, let the commit work setup the chip again */
+	if (ret)
+		led->setup_done = false;
+	if (ret || led->retry_delay_ms)
+		queue_delayed_work(system_wq, &led->commit_work, 0);
+	mutex_unlock(&led->io_lock);
+	if (checked)
+		nct6795d_led_io_end(led, NCT6795D_OP_RESUME, &io_start);
+	if (start) {
+		led->restore_ns = ktime_ns_delta(ktime_get(), start);
+		trace_nct6795d_led_resume(led->restore_ns, ret);
+	}
+
+	if (ret)
+		dev_warn(led->dev, "failed to restore state on resume: %d\n",
+			 ret);
+}
+EXPORT_SYMBOL_IF_NCT6795D_TESTS(nct6795d_led_restore_work);
 
 static int nct6795d_led_probe(struct platform_device *pdev)
 {
+	const struct nct6795d_led_pdata *pdata = dev_get_platdata(&pdev->dev);
 	struct nct6795d_led *led;
-	const struct resource *res;
+	unsigned long flags;
+	ktime_t start = 0;
 	int ret;
 
+	if (!pdata)
+		return -EINVAL;
+
+	if (nct6795d_timing_on())
+		start = ktime_get();
+
 	led = devm_kzalloc(&pdev->dev, sizeof(*led), GFP_KERNEL);
 	if (!led)
 		return -ENOMEM;
 
 	led->dev = &pdev->dev;
+	led->adopt = pdata->adopt;
+	led->step_duration = DEFAULT_STEP_DURATION;
+	/* LED enabled, no inversion, unless adopted from the firmware */
+	led->state.enable = true;
+	led->state.disable_board_led = true;
+	spin_lock_init(&led->lock);
+	mutex_init(&led->io_lock);
+	INIT_DELAYED_WORK(&led->commit_work, nct6795d_led_commit_work);
+	INIT_WORK(&led->restore_work, nct6795d_led_restore_work);
+
+	led->client = nct6795d_sio_client_get(pdata->io, pdata->base_port,
+					      dev_name(&pdev->dev));
+	if (IS_ERR(led->client))
+		return PTR_ERR(led->client);
+
+	ret = devm_add_action_or_reset(&pdev->dev, nct6795d_led_client_put,
+				       led->client);
+	if (ret)
+		return ret;
 
-	res = platform_get_resource_byname(pdev, IORESOURCE_REG, "io_base");
-	if (IS_ERR(res))
-		return PTR_ERR(res);
-
-	led->base_port = res->start;
+	led->regmap = devm_regmap_init(&pdev->dev, &nct6795d_regmap_bus,
+				       led->client, &nct6795d_regmap_config);
+	if (IS_ERR(led->regmap))
+		return PTR_ERR(led->regmap);
 
 	led->subled[RED].color_index = LED_COLOR_ID_RED;
 	led->subled[RED].channel = 0;
-	led->subled[RED].intensity = 0;
+	led->subled[RED].intensity = min(r, 0xfU);
 	led->subled[GREEN].color_index = LED_COLOR_ID_GREEN;
 	led->subled[GREEN].channel = 1;
-	led->subled[GREEN].intensity = 0;
+	led->subled[GREEN].intensity = min(g, 0xfU);
 	led->subled[BLUE].color_index = LED_COLOR_ID_BLUE;
 	led->subled[BLUE].channel = 2;
-	led->subled[BLUE].intensity = 0;
+	led->subled[BLUE].intensity = min(b, 0xfU);
 
 	led->mc_cdev.subled_info = led->subled;
 	led->mc_cdev.num_colors = NUM_COLORS;
 	led->mc_cdev.led_cdev.name = NCT6795D_DEVICE_NAME;
 	led->mc_cdev.led_cdev.max_brightness = 0xf;
 	led->mc_cdev.led_cdev.brightness = led->mc_cdev.led_cdev.max_brightness;
+	led->mc_cdev.led_cdev.groups = nct6795d_led_groups;
 	led->mc_cdev.led_cdev.brightness_set = nct6795d_led_brightness_set;
+	led->mc_cdev.led_cdev.blink_set = nct6795d_led_blink_set;
+	led->mc_cdev.led_cdev.pattern_set = nct6795d_led_pattern_set;
+	led->mc_cdev.led_cdev.pattern_clear = nct6795d_led_pattern_clear;
+
+	/* Seed the initial state before userspace can change it */
+	spin_lock_irqsave(&led->lock, flags);
+	nct6795d_led_set_static(led, led->mc_cdev.led_cdev.brightness);
+	spin_unlock_irqrestore(&led->lock, flags);
+
+	if (!pdata->lazy_setup) {
+		/*
+		 * Commit the initial color right away, and populate the cache
+		 * of the color registers in the process. This is done before
+		 * the LED is registered, so an adopted color is what userspace
+		 * sees first.
+		 */
+		mutex_lock(&led->io_lock);
+		ret = nct6795d_led_bringup(led, true);
+		mutex_unlock(&led->io_lock);
+		if (ret)
+			return ret;
+
+		dev_dbg(&pdev->dev, "%s chip at 0x%x ready\n",
+			chip_names[pdata->chip], pdata->base_port);
+	}
+
+	/* Must be registered before the LED so it runs after it is removed */
+	ret = devm_add_action_or_reset(&pdev->dev, nct6795d_led_cancel_work,
+				       led);
+	if (ret)
+		return ret;
 
 	ret = devm_led_classdev_multicolor_register_ext(&pdev->dev,
 							&led->mc_cdev, NULL);
@@ -320,13 +1585,21 @@ static int nct6795d_led_probe(struct platform_device *pdev)
 		return ret;
 
 	dev_set_drvdata(&pdev->dev, led);
+	device_enable_async_suspend(&pdev->dev);
 
-	ret = nct6795d_led_setup(led);
+	ret = nct6795d_led_debugfs_init(led);
 	if (ret)
 		return ret;
 
-	nct6795d_led_brightness_set(&led->mc_cdev.led_cdev,
-				    led->mc_cdev.led_cdev.brightness);
+	/*
+	 * With lazy_setup, the chip is setup by the commit work upon the first
+	 * request. Initial intensities given as parameters count as one.
+	 */
+	if (pdata->lazy_setup && (r || g || b))
+		nct6795d_led_schedule_commit(led);
+
+	if (start)
+		led->probe_ns = ktime_ns_delta(ktime_get(), start);
 
 	return 0;
 }
@@ -334,19 +1607,34 @@ static int nct6795d_led_probe(struct platform_device *pdev)
 #ifdef CONFIG_PM_SLEEP
 static int nct6795d_led_suspend(struct device *dev)
 {
+	struct nct6795d_led *led = dev_get_drvdata(dev);
+
+	/* The restore of the previous resume must not outlive the device */
+	flush_work(&led->restore_work);
+	/* Make sure the last requested color reached the hardware */
+	flush_delayed_work(&led->commit_work);
+	/* A commit being retried is resumed along with the device */
+	cancel_delayed_work_sync(&led->commit_work);
+	nct6795d_sio_flush(led->client);
+
 	return 0;
 }
 
 static int nct6795d_led_resume(struct device *dev)
 {
 	struct nct6795d_led *led = dev_get_drvdata(dev);
-	int ret;
+	ktime_t start = 0;
 
-	ret = nct6795d_led_setup(led);
-	if (ret)
-		return ret;
+	if (nct6795d_timing_on())
+		start = ktime_get();
+
+	/* Restore the LED without holding up the rest of the system resume */
+	queue_work(system_wq, &led->restore_work);
 
-	return nct6795d_led_commit(led);
+	if (start)
+		led->resume_ns = ktime_ns_delta(ktime_get(), start);
+
+	return 0;
 }
 #endif
 
@@ -357,6 +1645,8 @@ static struct platform_driver nct6795d_led_driver = {
 	.driver = {
 		.name = "nct6795d_led",
 		.pm = &nct_6795d_led_pm_ops,
+		/* Nothing depends on the LED, don't hold up the boot */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = nct6795d_led_probe,
 };
@@ -366,22 +1656,24 @@ static struct platform_device *nct6795d_led_pdev;
 static int __init nct6795d_led_init(void)
 {
 	static const u16 io_bases[] = { 0x4e, 0x2e };
-	struct resource io_res = {
-		.name = "io_base",
-		.flags = IORESOURCE_REG,
-	};
+	struct nct6795d_led_pdata pdata;
 	int detected_chip;
 	int ret;
 	int i;
 
 	for (i = 0; i < ARRAY_SIZE(io_bases); i++) {
-		detected_chip = nct6795d_led_detect(io_bases[i]);
+		detected_chip = nct6795d_led_detect(NULL, io_bases[i]);
 		if (detected_chip >= 0)
 			break;
 	}
 	if (i == ARRAY_SIZE(io_bases)) {
+#ifdef NCT6795D_TESTS
+		/* The test module adds devices on a simulated chip */
+		return platform_driver_register(&nct6795d_led_driver);
+#else
 		pr_err(KBUILD_MODNAME ": no supported chip detected\n");
 		return -ENODEV;
+#endif
 	}
 
 	pr_info(KBUILD_MODNAME ": found %s chip at address 0x%x\n",
@@ -398,20 +1690,24 @@ static int __init nct6795d_led_init(void)
 		goto error_pdev_alloc;
 	}
 
-	io_res.start = io_bases[i];
-	io_res.end = io_res.start;
-	ret = platform_device_add_resources(nct6795d_led_pdev, &io_res, 1);
+	pdata.chip = detected_chip;
+	pdata.io = NULL;
+	pdata.base_port = io_bases[i];
+	pdata.adopt = adopt;
+	pdata.lazy_setup = lazy_setup;
+	ret = platform_device_add_data(nct6795d_led_pdev, &pdata,
+				       sizeof(pdata));
 	if (ret)
-		goto error_pdev_resource;
+		goto error_pdev_add;
 
 	ret = platform_device_add(nct6795d_led_pdev);
 	if (ret)
-		goto error_pdev_resource;
+		goto error_pdev_add;
 
 	return 0;
 
-error_pdev_resource:
-	platform_device_del(nct6795d_led_pdev);
+error_pdev_add:
+	platform_device_put(nct6795d_led_pdev);
 error_pdev_alloc:
 	platform_driver_unregister(&nct6795d_led_driver);
 	return ret;
@@ -421,6 +1717,9 @@ static void __exit nct6795d_led_exit(void)
 {
 	platform_device_unregister(nct6795d_led_pdev);
 	platform_driver_unregister(&nct6795d_led_driver);
+	/* Release the accounting of the Super I/O sessions */
+	nct6795d_led_key_set(&nct6795d_stats_enabled, false);
+	nct6795d_led_key_set(&nct6795d_verify_enabled, false);
 }
 
 module_init(nct6795d_led_init);
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * NCT6795D/NCT6797D LED driver internals
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ *
+ * Shared by the driver and its test module, which drives it against a
+ * simulated chip. Nothing here is part of an interface to other drivers.
+ */
+
+#ifndef _LEDS_NCT6795D_H
+#define _LEDS_NCT6795D_H
+
+#include <linux/atomic.h>
+#include <linux/jump_label.h>
+#include <linux/ktime.h>
+#include <linux/leds.h>
+#include <linux/led-class-multicolor.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+#include "nct6795d-sio.h"
+
+/*
+ * Driver functions used by the test module are only visible to it in builds
+ * with NCT6795D_TESTS=1.
+ */
+#ifdef NCT6795D_TESTS
+#define VISIBLE_IF_NCT6795D_TESTS
+#define EXPORT_SYMBOL_IF_NCT6795D_TESTS(sym)                                   \
+	EXPORT_SYMBOL_NS_GPL(sym, "NCT6795D_TESTS")
+#else
+#define VISIBLE_IF_NCT6795D_TESTS static
+#define EXPORT_SYMBOL_IF_NCT6795D_TESTS(sym)
+#endif
+
+#define NCT6795D_DEVICE_NAME "nct6795d"
+
+#define NCTLEDS_CHIP_NCT6795D 0
+#define NCTLEDS_CHIP_NCT6797D 1
+
+/* Passed by the module to the device it creates for the detected chip */
+struct nct6795d_led_pdata {
+	/* NCTLEDS_CHIP_* */
+	int chip;
+	/* I/O backend of the Super I/O, NULL for the I/O ports */
+	struct nct6795d_io *io;
+	u16 base_port;
+	/* Probe options, the adopt and lazy_setup parameters for the chip */
+	bool adopt;
+	bool lazy_setup;
+};
+
+#define NCT6795D_RGB_BANK 0x12
+
+/* Global enable register, in logical device 0x09 */
+#define NCT6795D_LD09 0x09
+#define NCT6795D_LD09_ENABLE 0x2c
+
+/* RGB control enable */
+#define NCT6795D_RGB_ENABLE 0xe0
+
+/* Color registers */
+#define NCT6795D_RED_CELL 0xf0
+#define NCT6795D_GREEN_CELL 0xf4
+#define NCT6795D_BLUE_CELL 0xf8
+/* Number of bytes per color cell */
+#define NCT6795D_CELL_SIZE 4
+/* Number of color registers, starting at NCT6795D_RED_CELL */
+#define NCT6795D_NUM_CELLS (3 * NCT6795D_CELL_SIZE)
+#define NCT6795D_LAST_CELL (NCT6795D_RED_CELL + NCT6795D_NUM_CELLS - 1)
+/* Number of time frames, each register of a cell holding two of them */
+#define NCT6795D_NUM_FRAMES (2 * NCT6795D_CELL_SIZE)
+
+#define NCT6795D_PARAMS_0 0xe4
+/* Enable/disable LED overall */
+#define PARAMS_0_LED_ENABLE(e) ((e) ? 0x0 : 0x1)
+/* Enable/disable smooth pulsing */
+#define PARAMS_0_LED_PULSE_ENABLE(e) ((e) ? 0x08 : 0x0)
+/* Duration between blinks (0 means always on) */
+#define PARAMS_0_BLINK_DURATION(x) ((x) & 0x07)
+
+#define NCT6795D_PARAMS_1 0xfe
+/* Lower part of step duration (8 out of 9 bits) */
+#define PARAMS_1_STEP_DURATION_LOW(s) ((s) & 0xff)
+
+#define NCT6795D_PARAMS_2 0xff
+/* Enable fade-in effect for specified primitive */
+#define PARAMS_2_FADE_COLOR(r, g, b)                                           \
+	(0xe0 ^ (((r) ? 0x80 : 0x0) | ((g) ? 0x40 : 0x0) | ((b) ? 0x20 : 0x0)))
+/* Whether the specified colors should be inverted */
+#define PARAMS_2_INVERT_COLOR(r, g, b)                                         \
+	(((r) ? 0x10 : 0x0) | ((g) ? 0x08 : 0x0) | ((b) ? 0x04 : 0x0))
+/* Disable board leds if the LED_DISABLE bit is set */
+#define PARAMS_2_DISABLE_BOARD_LED 0x02
+/* MSB (9th bit) of step duration */
+#define PARAMS_2_STEP_DURATION_HIGH(s) (((s) >> 8) & 0x01)
+
+#define NCT6795D_MAX_STEP_DURATION 0x1ff
+
+enum { RED = 0, GREEN, BLUE, NUM_COLORS };
+
+/*
+ * State of the LED to be committed to the hardware.
+ */
+struct nct6795d_led_state {
+	/* Intensity of each color for each time frame */
+	u8 frames[NUM_COLORS][NCT6795D_NUM_FRAMES];
+	/* Duration of a time frame, in hardware units */
+	u16 step_duration;
+	/* Blink duration, i.e. index into nct6795d_blink_periods */
+	u8 blink;
+	/* Smooth pulsing (breathing), at a pace set by step_duration */
+	bool pulse;
+	/* Fade each color to its new intensity, at step_duration pace */
+	bool fade[NUM_COLORS];
+	/* LED turned on, set again by any static color */
+	bool enable;
+	/* Invert each color */
+	bool invert[NUM_COLORS];
+	/* Turn the board LEDs off when the LED is */
+	bool disable_board_led;
+};
+
+/*
+ * Operations which port I/O cost is checked against a budget, to catch
+ * regressions.
+ */
+enum nct6795d_op {
+	NCT6795D_OP_PROBE,
+	NCT6795D_OP_PROBE_ADOPT,
+	NCT6795D_OP_SETUP,
+	NCT6795D_OP_COMMIT_NOOP,
+	NCT6795D_OP_COMMIT_SINGLE,
+	NCT6795D_OP_COMMIT_FULL,
+	NCT6795D_OP_RESUME,
+	NCT6795D_NUM_OPS,
+};
+
+struct nct6795d_led_stats {
+	/* State changes requested by the LED core or user-space */
+	atomic64_t requests;
+	/* Requests merged into an already pending commit */
+	atomic64_t coalesced;
+	/* Commits performed, and how many of them failed */
+	atomic64_t commits;
+	atomic64_t errors;
+	/*
+	 * Time between the oldest request not committed yet and the end of the
+	 * commit that reaches the hardware
+	 */
+	struct nct6795d_hist latency;
+};
+
+struct nct6795d_led {
+	struct device *dev;
+	struct nct6795d_sio_client *client;
+	struct led_classdev_mc mc_cdev;
+	struct mc_subled subled[NUM_COLORS];
+
+	/* Protects state */
+	spinlock_t lock;
+	/* Last requested state, not committed yet */
+	struct nct6795d_led_state state;
+	/* Time of the oldest request not committed yet, if stats are enabled */
+	ktime_t request_time;
+	/* Whether a hardware pattern is set */
+	bool pattern;
+	/* Step duration used when no pattern is set */
+	u16 step_duration;
+	/* Commits the last requested state to the hardware */
+	struct delayed_work commit_work;
+	/* Restores the state of the chip after resume */
+	struct work_struct restore_work;
+
+	/* Serializes hardware access */
+	struct mutex io_lock;
+	struct regmap *regmap;
+	/* Whether the state set by the firmware is adopted at bringup */
+	bool adopt;
+	/* Whether the chip has been setup, protected by io_lock */
+	bool setup_done;
+	/*
+	 * Whether the last commit failed, protected by io_lock. The regmap
+	 * cache is updated before the hardware is written, so it may then hold
+	 * values which never reached the chip.
+	 */
+	bool commit_failed;
+	/* Delay before retrying a commit which found the Super I/O busy */
+	unsigned int retry_delay_ms;
+
+	struct dentry *debugfs;
+	/* Number of color register writes avoided thanks to the regmap cache */
+	u64 skipped_writes;
+	/* Number of commits retried because the Super I/O was busy */
+	u64 retries;
+	/* Port I/O of the last occurrence of each operation */
+	struct nct6795d_io_count io_last[NCT6795D_NUM_OPS];
+	/*
+	 * Duration in ns of the probe, of the last resume callback and of the
+	 * last restore, if instrumented
+	 */
+	s64 probe_ns;
+	s64 resume_ns;
+	s64 restore_ns;
+	struct nct6795d_led_stats stats;
+};
+
+#ifdef NCT6795D_TESTS
+/* Instrumentation keys, see nct6795d_led_key_set() */
+DECLARE_STATIC_KEY_FALSE(nct6795d_stats_enabled);
+DECLARE_STATIC_KEY_FALSE(nct6795d_verify_enabled);
+
+void nct6795d_led_key_set(struct static_key_false *key, bool enable);
+int nct6795d_led_setup(struct nct6795d_led *led);
+int nct6795d_led_commit(struct nct6795d_led *led, bool force);
+int nct6795d_led_bringup(struct nct6795d_led *led, bool probing);
+void nct6795d_led_restore_work(struct work_struct *work);
+#endif
+
+#endif /* _LEDS_NCT6795D_H */
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Simulated NCT6795D chip
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ */
+
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+
+#include "leds-nct6795d.h"
+#include "nct6795d-sim.h"
+#include "nct6795d-sio.h"
+
+static u8 *nct6795d_sim_reg(struct nct6795d_sim *sim)
+{
+	if (sim->index < NCT6795D_SIM_NUM_GLOBAL_REGS)
+		return &sim->global[sim->index];
+
+	return &sim->regs[sim->global[SIO_REG_LDSEL] % NCT6795D_SIM_NUM_LDS]
+			 [sim->index];
+}
+
+static bool nct6795d_sim_request(void *priv, u16 port)
+{
+	struct nct6795d_sim *sim = priv;
+
+	down(&sim->region);
+	return true;
+}
+
+static void nct6795d_sim_release(void *priv, u16 port)
+{
+	struct nct6795d_sim *sim = priv;
+
+	up(&sim->region);
+}
+
+static u8 nct6795d_sim_inb(void *priv, u16 port)
+{
+	struct nct6795d_sim *sim = priv;
+	unsigned long flags;
+	u8 val = 0xff;
+
+	spin_lock_irqsave(&sim->lock, flags);
+
+	sim->reads++;
+	if (port == NCT6795D_SIM_BASE + 1 && sim->config)
+		val = *nct6795d_sim_reg(sim);
+
+	spin_unlock_irqrestore(&sim->lock, flags);
+	return val;
+}
+
+static void nct6795d_sim_outb(void *priv, u8 val, u16 port)
+{
+	struct nct6795d_sim *sim = priv;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+
+	sim->writes++;
+	if (port == NCT6795D_SIM_BASE && !sim->config) {
+		sim->keys = val == 0x87 ? sim->keys + 1 : 0;
+		if (sim->keys == 2) {
+			sim->config = true;
+			sim->config_start = ktime_get();
+			sim->sessions++;
+		}
+	} else if (port == NCT6795D_SIM_BASE) {
+		if (val == 0xaa) {
+			sim->config = false;
+			sim->keys = 0;
+			sim->config_ns += ktime_to_ns(
+				ktime_sub(ktime_get(), sim->config_start));
+		} else {
+			sim->index = val;
+		}
+	} else if (port == NCT6795D_SIM_BASE + 1 && sim->config) {
+		/* The device ID is read-only */
+		if (sim->index != SIO_REG_DEVID &&
+		    sim->index != SIO_REG_DEVID + 1)
+			*nct6795d_sim_reg(sim) = val;
+	}
+
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+const struct nct6795d_io_ops nct6795d_sim_io_ops = {
+	.request = nct6795d_sim_request,
+	.release = nct6795d_sim_release,
+	.inb = nct6795d_sim_inb,
+	.outb = nct6795d_sim_outb,
+};
+
+struct nct6795d_sim *nct6795d_sim_create(void)
+{
+	struct nct6795d_sim *sim;
+
+	sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+	if (!sim)
+		return NULL;
+
+	sim->io.ops = &nct6795d_sim_io_ops;
+	sim->io.priv = sim;
+	sema_init(&sim->region, 1);
+	spin_lock_init(&sim->lock);
+	sim->global[SIO_REG_DEVID] = NCT6795D_SIM_DEVID >> 8;
+	sim->global[SIO_REG_DEVID + 1] = NCT6795D_SIM_DEVID & 0xff;
+
+	return sim;
+}
+
+void nct6795d_sim_destroy(struct nct6795d_sim *sim)
+{
+	kfree(sim);
+}
+
+struct platform_device *nct6795d_sim_add_led(struct nct6795d_sim *sim,
+					     int id, bool adopt)
+{
+	struct nct6795d_led_pdata pdata = {
+		.chip = NCTLEDS_CHIP_NCT6795D,
+		.io = &sim->io,
+		.base_port = NCT6795D_SIM_BASE,
+		.adopt = adopt,
+	};
+	struct platform_device *pdev;
+
+	pdev = platform_device_register_data(NULL, NCT6795D_DEVICE_NAME "_led",
+					     id, &pdata, sizeof(pdata));
+	if (IS_ERR(pdev))
+		return pdev;
+
+	/* The driver probes asynchronously */
+	wait_for_device_probe();
+	if (!platform_get_drvdata(pdev)) {
+		platform_device_unregister(pdev);
+		return ERR_PTR(-ENODEV);
+	}
+
+	return pdev;
+}
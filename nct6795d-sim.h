@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Simulated NCT6795D chip
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ *
+ * Lets the test module drive the LED driver on any machine.
+ */
+
+#ifndef _NCT6795D_SIM_H
+#define _NCT6795D_SIM_H
+
+#include <linux/ktime.h>
+#include <linux/semaphore.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+#include "nct6795d-sio.h"
+
+struct platform_device;
+
+#define NCT6795D_SIM_BASE 0x2e
+#define NCT6795D_SIM_DEVID 0xd352
+/* Registers below this index are shared by all logical devices */
+#define NCT6795D_SIM_NUM_GLOBAL_REGS 0x30
+#define NCT6795D_SIM_NUM_LDS 0x20
+
+/*
+ * Simulated Super I/O chip, answering at NCT6795D_SIM_BASE. It implements the
+ * entry/exit key protocol and logical device banking, and keeps track of the
+ * number of port accesses and of the time spent in configuration mode.
+ */
+struct nct6795d_sim {
+	/* Backend of the Super I/O clients, with the simulator as priv */
+	struct nct6795d_io io;
+	/* Emulates the muxed I/O region */
+	struct semaphore region;
+	/* Protects the fields below */
+	spinlock_t lock;
+	u8 global[NCT6795D_SIM_NUM_GLOBAL_REGS];
+	u8 regs[NCT6795D_SIM_NUM_LDS][256];
+	/* Currently selected register */
+	u8 index;
+	/* Number of consecutive entry keys received */
+	unsigned int keys;
+	bool config;
+	ktime_t config_start;
+
+	u64 reads;
+	u64 writes;
+	u64 sessions;
+	u64 config_ns;
+};
+
+extern const struct nct6795d_io_ops nct6795d_sim_io_ops;
+
+struct nct6795d_sim *nct6795d_sim_create(void);
+void nct6795d_sim_destroy(struct nct6795d_sim *sim);
+
+/*
+ * Add an LED device driving sim, with the given platform device id, and wait
+ * for it to be probed. The chip is setup at probe, and the state found in sim
+ * is adopted if adopt is set, regardless of the module parameters. Return the
+ * device, which drvdata is the LED, or an error pointer if it could not be
+ * added or probed.
+ */
+struct platform_device *nct6795d_sim_add_led(struct nct6795d_sim *sim,
+					     int id, bool adopt);
+
+#endif /* _NCT6795D_SIM_H */
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * NCT6795D/NCT6797D shared Super I/O sessions trace events
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nct6795d_sio
+
+#if !defined(_NCT6795D_SIO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _NCT6795D_SIO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(nct6795d_sio_enter,
+	TP_PROTO(u16 base_port, s64 wait_ns),
+	TP_ARGS(base_port, wait_ns),
+
+	TP_STRUCT__entry(
+		__field(u16, base_port)
+		__field(s64, wait_ns)
+	),
+
+	TP_fast_assign(
+		__entry->base_port = base_port;
+		__entry->wait_ns = wait_ns;
+	),
+
+	TP_printk("base=0x%x wait_ns=%lld", __entry->base_port,
+		  __entry->wait_ns)
+);
+
+TRACE_EVENT(nct6795d_sio_exit,
+	TP_PROTO(u16 base_port, s64 held_ns),
+	TP_ARGS(base_port, held_ns),
+
+	TP_STRUCT__entry(
+		__field(u16, base_port)
+		__field(s64, held_ns)
+	),
+
+	TP_fast_assign(
+		__entry->base_port = base_port;
+		__entry->held_ns = held_ns;
+	),
+
+	TP_printk("base=0x%x held_ns=%lld", __entry->base_port,
+		  __entry->held_ns)
+);
+
+#endif /* _NCT6795D_SIO_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nct6795d-sio-trace
+#include <trace/define_trace.h>
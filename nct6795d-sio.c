@@ -0,0 +1,722 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * NCT6795D/NCT6797D shared Super I/O sessions
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ *
+ * Entering and exiting the configuration mode of the Super I/O is costly, and
+ * the mode is shared by all the functions of the chip. This module lets their
+ * drivers share configuration mode sessions, see nct6795d-sio.h.
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/io.h>
+#include <linux/ioport.h>
+#include <linux/jump_label.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+
+#include "nct6795d-sio.h"
+
+#ifndef NCT6795D_NO_INSTRUMENTATION
+#define CREATE_TRACE_POINTS
+#endif
+#include "nct6795d-sio-trace.h"
+
+/*
+ * Accounting is disabled by default and enabled by the clients which need it.
+ * When disabled, it costs a patched out branch. It can also be compiled out,
+ * see NCT6795D_INSTRUMENTATION.
+ */
+static DEFINE_STATIC_KEY_FALSE(nct6795d_sio_accounting);
+
+#define nct6795d_sio_accounting_on()                                           \
+	(NCT6795D_INSTRUMENTATION &&                                           \
+	 static_branch_unlikely(&nct6795d_sio_accounting))
+
+/*
+ * Return an upper bound of the given percentile of the durations.
+ */
+static u64 nct6795d_hist_percentile(const struct nct6795d_hist *hist,
+				    unsigned int percent)
+{
+	u64 target = DIV_ROUND_UP_ULL(hist->count * percent, 100);
+	u64 sum = 0;
+	int i;
+
+	for (i = 0; i < NCT6795D_HIST_BUCKETS; i++) {
+		sum += hist->buckets[i];
+		if (sum >= target)
+			break;
+	}
+
+	if (i >= NCT6795D_HIST_BUCKETS - 1)
+		return hist->max_ns;
+
+	return min(BIT_ULL(i) - 1, hist->max_ns);
+}
+
+void nct6795d_hist_show(struct seq_file *s, const char *name,
+			const struct nct6795d_hist *hist)
+{
+	int i;
+
+	seq_printf(s, "%s: count %llu, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+		   name, hist->count, nct6795d_hist_percentile(hist, 50),
+		   nct6795d_hist_percentile(hist, 99), hist->max_ns);
+
+	for (i = 0; i < NCT6795D_HIST_BUCKETS; i++) {
+		if (hist->buckets[i])
+			seq_printf(s, "  < %llu ns: %llu\n", BIT_ULL(i),
+				   hist->buckets[i]);
+	}
+}
+EXPORT_SYMBOL_GPL(nct6795d_hist_show);
+
+/*
+ * Port accesses are accounted to the backend, and to the client they are
+ * performed for if count is not NULL.
+ */
+static inline u8 nct6795d_io_inb(struct nct6795d_io *io,
+				 struct nct6795d_io_count *count, u16 port)
+{
+	if (nct6795d_sio_accounting_on()) {
+		io->count.reads++;
+		if (count)
+			count->reads++;
+	}
+	return io->ops->inb(io->priv, port);
+}
+
+static inline void nct6795d_io_outb(struct nct6795d_io *io,
+				    struct nct6795d_io_count *count, u8 val,
+				    u16 port)
+{
+	if (nct6795d_sio_accounting_on()) {
+		io->count.writes++;
+		if (count)
+			count->writes++;
+	}
+	io->ops->outb(io->priv, val, port);
+}
+
+static bool nct6795d_port_request(void *priv, u16 port)
+{
+	return request_muxed_region(port, 2, KBUILD_MODNAME);
+}
+
+static void nct6795d_port_release(void *priv, u16 port)
+{
+	release_region(port, 2);
+}
+
+static u8 nct6795d_port_inb(void *priv, u16 port)
+{
+	return inb(port);
+}
+
+static void nct6795d_port_outb(void *priv, u8 val, u16 port)
+{
+	outb(val, port);
+}
+
+static const struct nct6795d_io_ops nct6795d_port_io_ops = {
+	.request = nct6795d_port_request,
+	.release = nct6795d_port_release,
+	.inb = nct6795d_port_inb,
+	.outb = nct6795d_port_outb,
+};
+
+static struct nct6795d_io nct6795d_port_io = {
+	.ops = &nct6795d_port_io_ops,
+};
+
+/* Adapted from drivers/hwmon/nct6775.c */
+
+static inline void superio_outb(struct nct6795d_io *io,
+				struct nct6795d_io_count *count, int ioreg,
+				int reg, int val)
+{
+	nct6795d_io_outb(io, count, reg, ioreg);
+	nct6795d_io_outb(io, count, val, ioreg + 1);
+}
+
+static inline int superio_inb(struct nct6795d_io *io,
+			      struct nct6795d_io_count *count, int ioreg,
+			      int reg)
+{
+	nct6795d_io_outb(io, count, reg, ioreg);
+	return nct6795d_io_inb(io, count, ioreg + 1);
+}
+
+static inline void superio_select(struct nct6795d_io *io,
+				  struct nct6795d_io_count *count, int ioreg,
+				  int ld)
+{
+	nct6795d_io_outb(io, count, SIO_REG_LDSEL, ioreg);
+	nct6795d_io_outb(io, count, ld, ioreg + 1);
+}
+
+static int superio_enter(struct nct6795d_io *io,
+			 struct nct6795d_io_count *count, int ioreg)
+{
+	if (!io->ops->request(io->priv, ioreg))
+		return -EBUSY;
+
+	if (nct6795d_sio_accounting_on()) {
+		io->count.sessions++;
+		count->sessions++;
+	}
+
+	nct6795d_io_outb(io, count, 0x87, ioreg);
+	nct6795d_io_outb(io, count, 0x87, ioreg);
+
+	return 0;
+}
+
+static void superio_exit(struct nct6795d_io *io,
+			 struct nct6795d_io_count *count, int ioreg)
+{
+	nct6795d_io_outb(io, count, 0xaa, ioreg);
+	nct6795d_io_outb(io, count, 0x02, ioreg);
+	nct6795d_io_outb(io, count, 0x02, ioreg + 1);
+	io->ops->release(io->priv, ioreg);
+}
+
+/* End adapted from drivers/hwmon/nct6775.c */
+
+static unsigned int linger_ms = 10;
+module_param(linger_ms, uint, 0644);
+MODULE_PARM_DESC(linger_ms,
+		 "Time in ms the Super I/O is kept in configuration mode after an access, in case another one follows, within chunk_hold_us of entering it (default: 10)");
+
+static unsigned int max_hold_ms = 50;
+module_param(max_hold_ms, uint, 0644);
+MODULE_PARM_DESC(max_hold_ms,
+		 "Maximum time in ms the Super I/O can be kept in configuration mode (default: 50)");
+
+static unsigned int chunk_hold_us = 200;
+module_param(chunk_hold_us, uint, 0644);
+MODULE_PARM_DESC(chunk_hold_us,
+		 "Time in us after which the configuration mode is left when idle or between the chunks of a large update, to let other users in (0: never, default: 200)");
+
+/*
+ * Super I/O session, shared by all the clients of a Super I/O.
+ *
+ * Entering and exiting the configuration mode is costly, so a session is kept
+ * open for up to linger_ms after its last access in case another one follows,
+ * from any client. Users of the Super I/O which are not clients (e.g. the
+ * nct6775 hwmon driver) wait for the region meanwhile, so an idle session is
+ * not kept open more than chunk_hold_us after being opened, and holders yield
+ * it after chunk_hold_us between the chunks of their updates. A session is
+ * closed no later than max_hold_ms after being opened in any case.
+ */
+struct nct6795d_sio {
+	struct nct6795d_io *io;
+	u16 base_port;
+	/* Node in nct6795d_sio_list and number of clients, under its lock */
+	struct list_head node;
+	unsigned int refs;
+	/* Serializes accesses and protects the fields below */
+	struct mutex lock;
+	/* Clients of the session */
+	struct list_head clients;
+	bool open;
+	/* Time at which the session was opened */
+	ktime_t open_time;
+	/*
+	 * Time from which the current holder has held the session: its get or
+	 * begin, or the opening of the session if later
+	 */
+	ktime_t hold_start;
+	/* Client which opened the session, and is accounted for closing it */
+	struct nct6795d_sio_client *owner;
+	/* Number of nct6795d_sio_get() calls not balanced by a put yet */
+	unsigned int holders;
+	/* Currently selected logical device, or -1 if unknown */
+	int ld;
+	/* Time at which an open session must be closed */
+	ktime_t deadline;
+	/*
+	 * Time at which the session is closed if not used meanwhile. The timer
+	 * fires then and queues the work, which closes the session.
+	 */
+	ktime_t exit_time;
+	struct hrtimer exit_timer;
+	struct work_struct exit_work;
+
+	/* Number of times the region could not be requested */
+	u64 busy;
+	/* Number of times the session was left between chunks of an update */
+	u64 yields;
+	/* Total and maximum time spent in configuration mode */
+	u64 hold_total_ns;
+	u64 hold_max_ns;
+	struct nct6795d_hist hold_hist;
+};
+
+/*
+ * Client of a shared session. When accounting is enabled, its accesses are
+ * accounted separately, to show how much clients delay each other.
+ */
+struct nct6795d_sio_client {
+	struct nct6795d_sio *sio;
+	const char *name;
+	/* Node in the clients list of the session */
+	struct list_head node;
+
+	/* Time at which the current access started, if accounted */
+	ktime_t begin_time;
+	/* Accesses, time spent waiting for the session and holding it */
+	u64 accesses;
+	u64 wait_ns;
+	u64 hold_ns;
+	/* Port I/O performed for the client */
+	struct nct6795d_io_count count;
+};
+
+/* Sessions, one per I/O backend and Super I/O base port */
+static LIST_HEAD(nct6795d_sio_list);
+static DEFINE_MUTEX(nct6795d_sio_list_lock);
+
+static void nct6795d_sio_close(struct nct6795d_sio *sio)
+{
+	s64 held_ns;
+
+	lockdep_assert_held(&sio->lock);
+
+	if (!sio->open)
+		return;
+
+	superio_exit(sio->io, sio->owner ? &sio->owner->count : NULL,
+		     sio->base_port);
+	sio->open = false;
+	sio->owner = NULL;
+
+	if (!nct6795d_sio_accounting_on() &&
+	    !trace_nct6795d_sio_exit_enabled())
+		return;
+
+	held_ns = ktime_to_ns(ktime_sub(ktime_get(), sio->open_time));
+	if (nct6795d_sio_accounting_on()) {
+		sio->hold_total_ns += held_ns;
+		sio->hold_max_ns = max_t(u64, sio->hold_max_ns, held_ns);
+		nct6795d_hist_add(&sio->hold_hist, held_ns);
+	}
+
+	trace_nct6795d_sio_exit(sio->base_port, held_ns);
+}
+
+static void nct6795d_sio_exit_work(struct work_struct *work)
+{
+	struct nct6795d_sio *sio = container_of(work, struct nct6795d_sio,
+						exit_work);
+
+	mutex_lock(&sio->lock);
+	/* Unless the session was used again since the timer was started */
+	if (!ktime_before(ktime_get(), sio->exit_time))
+		nct6795d_sio_close(sio);
+	mutex_unlock(&sio->lock);
+}
+
+static enum hrtimer_restart nct6795d_sio_exit_timer(struct hrtimer *timer)
+{
+	struct nct6795d_sio *sio = container_of(timer, struct nct6795d_sio,
+						exit_timer);
+
+	queue_work(system_highpri_wq, &sio->exit_work);
+	return HRTIMER_NORESTART;
+}
+
+static void nct6795d_sio_init(struct nct6795d_sio *sio,
+			      struct nct6795d_io *io, u16 base_port)
+{
+	sio->io = io;
+	sio->base_port = base_port;
+	mutex_init(&sio->lock);
+	INIT_LIST_HEAD(&sio->clients);
+	hrtimer_setup(&sio->exit_timer, nct6795d_sio_exit_timer,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	INIT_WORK(&sio->exit_work, nct6795d_sio_exit_work);
+}
+
+/*
+ * Schedule the closing of the session after its last access. If the session is
+ * held, it is only closed once its deadline expires. Otherwise it lingers for
+ * linger_ms, but no later than chunk_hold_us after it was opened.
+ */
+static void nct6795d_sio_schedule_exit(struct nct6795d_sio *sio)
+{
+	unsigned int hold_us = chunk_hold_us;
+	ktime_t exit_time = sio->deadline;
+	ktime_t now = ktime_get();
+
+	lockdep_assert_held(&sio->lock);
+
+	if (!sio->open)
+		return;
+
+	if (!sio->holders) {
+		exit_time = min(exit_time, ktime_add_ms(now, linger_ms));
+		if (hold_us)
+			exit_time = min(exit_time,
+					ktime_add_us(sio->open_time, hold_us));
+	}
+
+	if (!ktime_before(now, exit_time)) {
+		nct6795d_sio_close(sio);
+		return;
+	}
+
+	sio->exit_time = exit_time;
+	hrtimer_start(&sio->exit_timer, exit_time, HRTIMER_MODE_ABS);
+}
+
+/*
+ * Keep the session open between accesses until nct6795d_sio_put() is called,
+ * e.g. to perform a sequence of register writes in a single session. The
+ * session is only entered upon the first access, so nothing happens if no
+ * access takes place. The deadline of the session is still honored.
+ */
+void nct6795d_sio_get(struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	mutex_lock(&sio->lock);
+	if (!sio->holders++)
+		sio->hold_start = ktime_get();
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_get);
+
+void nct6795d_sio_put(struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	mutex_lock(&sio->lock);
+	sio->holders--;
+	nct6795d_sio_schedule_exit(sio);
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_put);
+
+/*
+ * Start accessing the Super I/O, entering the configuration mode unless the
+ * previous session is still open. On success, the session is locked until
+ * nct6795d_sio_end() is called.
+ */
+int nct6795d_sio_begin(struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+	ktime_t call_time = 0;
+	ktime_t start = 0;
+	ktime_t now;
+	int ret;
+
+	if (nct6795d_sio_accounting_on())
+		call_time = ktime_get();
+
+	mutex_lock(&sio->lock);
+
+	now = ktime_get();
+	if (!sio->holders)
+		sio->hold_start = now;
+
+	if (sio->open && ktime_after(now, sio->deadline))
+		nct6795d_sio_close(sio);
+
+	if (!sio->open) {
+		if (trace_nct6795d_sio_enter_enabled())
+			start = ktime_get();
+		ret = superio_enter(sio->io, &client->count, sio->base_port);
+		if (ret) {
+			if (nct6795d_sio_accounting_on())
+				sio->busy++;
+			mutex_unlock(&sio->lock);
+			return ret;
+		}
+
+		sio->open = true;
+		sio->owner = client;
+		sio->open_time = ktime_get();
+		sio->hold_start = sio->open_time;
+		sio->ld = -1;
+		sio->deadline = ktime_add_ms(sio->open_time, max_hold_ms);
+
+		/* Mostly the time spent waiting for the muxed region */
+		if (start)
+			trace_nct6795d_sio_enter(sio->base_port,
+						 ktime_to_ns(sio->open_time -
+							     start));
+	}
+
+	if (call_time) {
+		client->begin_time = ktime_get();
+		client->wait_ns += ktime_to_ns(client->begin_time - call_time);
+		client->accesses++;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_begin);
+
+/*
+ * Done accessing the Super I/O for now. The session is either closed, or kept
+ * open until it is put, its linger time or its deadline expires.
+ */
+void nct6795d_sio_end(struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	if (client->begin_time) {
+		client->hold_ns += ktime_to_ns(ktime_get() -
+					       client->begin_time);
+		client->begin_time = 0;
+	}
+
+	nct6795d_sio_schedule_exit(sio);
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_end);
+
+static void nct6795d_sio_session_flush(struct nct6795d_sio *sio)
+{
+	/* The timer queues the work */
+	hrtimer_cancel(&sio->exit_timer);
+	cancel_work_sync(&sio->exit_work);
+
+	mutex_lock(&sio->lock);
+	nct6795d_sio_close(sio);
+	mutex_unlock(&sio->lock);
+}
+
+/*
+ * Close the session immediately if it is open.
+ */
+void nct6795d_sio_flush(struct nct6795d_sio_client *client)
+{
+	nct6795d_sio_session_flush(client->sio);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_flush);
+
+/*
+ * Called between the chunks of a large update. Leave the configuration mode if
+ * the current holder has held it for more than chunk_hold_us, so other users
+ * of the Super I/O waiting for the region can get it. The next access enters
+ * it again. The time the session lingered before is not counted, so a short
+ * update does not lose the session it reused.
+ */
+void nct6795d_sio_yield(struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+	unsigned int hold_us = chunk_hold_us;
+
+	if (!hold_us)
+		return;
+
+	mutex_lock(&sio->lock);
+
+	if (sio->open &&
+	    ktime_us_delta(ktime_get(), sio->hold_start) > hold_us) {
+		nct6795d_sio_close(sio);
+		if (nct6795d_sio_accounting_on())
+			sio->yields++;
+	}
+
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_yield);
+
+/*
+ * Select logical device ld, unless it is already selected in this session.
+ */
+void nct6795d_sio_select(struct nct6795d_sio_client *client, int ld)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	lockdep_assert_held(&sio->lock);
+
+	if (sio->ld == ld)
+		return;
+
+	superio_select(sio->io, &client->count, sio->base_port, ld);
+	sio->ld = ld;
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_select);
+
+u8 nct6795d_sio_inb(struct nct6795d_sio_client *client, u8 reg)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	lockdep_assert_held(&sio->lock);
+
+	return superio_inb(sio->io, &client->count, sio->base_port, reg);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_inb);
+
+void nct6795d_sio_outb(struct nct6795d_sio_client *client, u8 reg, u8 val)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	lockdep_assert_held(&sio->lock);
+
+	superio_outb(sio->io, &client->count, sio->base_port, reg, val);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_outb);
+
+struct nct6795d_sio_client *nct6795d_sio_client_get(struct nct6795d_io *io,
+						     u16 base_port,
+						     const char *name)
+{
+	struct nct6795d_sio_client *client;
+	struct nct6795d_sio *sio;
+
+	if (!io)
+		io = &nct6795d_port_io;
+
+	client = kzalloc(sizeof(*client), GFP_KERNEL);
+	if (!client)
+		return ERR_PTR(-ENOMEM);
+	client->name = name;
+
+	mutex_lock(&nct6795d_sio_list_lock);
+
+	list_for_each_entry(sio, &nct6795d_sio_list, node) {
+		if (sio->io == io && sio->base_port == base_port)
+			goto found;
+	}
+
+	sio = kzalloc(sizeof(*sio), GFP_KERNEL);
+	if (!sio) {
+		mutex_unlock(&nct6795d_sio_list_lock);
+		kfree(client);
+		return ERR_PTR(-ENOMEM);
+	}
+	nct6795d_sio_init(sio, io, base_port);
+	list_add(&sio->node, &nct6795d_sio_list);
+
+found:
+	sio->refs++;
+	client->sio = sio;
+
+	mutex_lock(&sio->lock);
+	list_add_tail(&client->node, &sio->clients);
+	mutex_unlock(&sio->lock);
+
+	mutex_unlock(&nct6795d_sio_list_lock);
+
+	return client;
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_client_get);
+
+void nct6795d_sio_client_put(struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	mutex_lock(&nct6795d_sio_list_lock);
+
+	mutex_lock(&sio->lock);
+	list_del(&client->node);
+	/* Closing the session is not accounted to anyone anymore */
+	if (sio->owner == client)
+		sio->owner = NULL;
+	mutex_unlock(&sio->lock);
+
+	if (--sio->refs == 0) {
+		list_del(&sio->node);
+		nct6795d_sio_session_flush(sio);
+		kfree(sio);
+	}
+
+	mutex_unlock(&nct6795d_sio_list_lock);
+
+	kfree(client);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_client_put);
+
+void nct6795d_sio_accounting_get(void)
+{
+	static_branch_inc(&nct6795d_sio_accounting);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_accounting_get);
+
+void nct6795d_sio_accounting_put(void)
+{
+	static_branch_dec(&nct6795d_sio_accounting);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_accounting_put);
+
+void nct6795d_sio_io_count(struct nct6795d_sio_client *client,
+			   struct nct6795d_io_count *count)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	mutex_lock(&sio->lock);
+	*count = client->count;
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_io_count);
+
+#ifdef NCT6795D_TESTS
+unsigned int nct6795d_sio_set_chunk_hold_us(unsigned int us)
+{
+	return xchg(&chunk_hold_us, us);
+}
+EXPORT_SYMBOL_NS_GPL(nct6795d_sio_set_chunk_hold_us, "NCT6795D_TESTS");
+#endif
+
+void nct6795d_sio_stats_show(struct seq_file *s,
+			     struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	mutex_lock(&sio->lock);
+	seq_printf(s, "port_reads: %llu\n", sio->io->count.reads);
+	seq_printf(s, "port_writes: %llu\n", sio->io->count.writes);
+	seq_printf(s, "sessions: %llu\n", sio->io->count.sessions);
+	seq_printf(s, "busy: %llu\n", sio->busy);
+	seq_printf(s, "yields: %llu\n", sio->yields);
+	seq_printf(s, "hold_total_ns: %llu\n", sio->hold_total_ns);
+	seq_printf(s, "hold_max_ns: %llu\n", sio->hold_max_ns);
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_stats_show);
+
+void nct6795d_sio_clients_show(struct seq_file *s,
+			       struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+	struct nct6795d_sio_client *c;
+
+	seq_puts(s,
+		 "# client: accesses, wait_ns, hold_ns, reads/writes/sessions\n");
+
+	mutex_lock(&sio->lock);
+	list_for_each_entry(c, &sio->clients, node)
+		seq_printf(s, "%s: %llu, %llu, %llu, %llu/%llu/%llu\n", c->name,
+			   c->accesses, c->wait_ns, c->hold_ns, c->count.reads,
+			   c->count.writes, c->count.sessions);
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_clients_show);
+
+void nct6795d_sio_latency_show(struct seq_file *s,
+			       struct nct6795d_sio_client *client)
+{
+	struct nct6795d_sio *sio = client->sio;
+
+	mutex_lock(&sio->lock);
+	nct6795d_hist_show(s, "sio_hold", &sio->hold_hist);
+	mutex_unlock(&sio->lock);
+}
+EXPORT_SYMBOL_GPL(nct6795d_sio_latency_show);
+
+MODULE_AUTHOR("Alexandre Courbot <gnurou@gmail.com>");
+MODULE_DESCRIPTION("Shared Super I/O sessions for NCT6795D");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * NCT6795D/NCT6797D shared Super I/O sessions
+ *
+ * Copyright (c) 2021 Alexandre Courbot <gnurou@gmail.com>
+ *
+ * Lets the drivers of the functions of a Super I/O chip (e.g. LEDs and hwmon)
+ * share its configuration mode. Accesses are serialized, and back-to-back
+ * accesses from any client reuse the same configuration mode session instead
+ * of entering and exiting it each time.
+ */
+
+#ifndef _NCT6795D_SIO_H
+#define _NCT6795D_SIO_H
+
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+
+struct seq_file;
+
+/*
+ * Statistics, port I/O accounting and trace events can be compiled out by
+ * building with NCT6795D_NO_INSTRUMENTATION=1, which also defines NOTRACE.
+ */
+#ifdef NCT6795D_NO_INSTRUMENTATION
+#define NCT6795D_INSTRUMENTATION false
+#else
+#define NCT6795D_INSTRUMENTATION true
+#endif
+
+#define SIO_REG_LDSEL 0x07 /* Logical device select */
+#define SIO_REG_DEVID 0x20 /* Device ID (2 bytes) */
+
+/*
+ * Port I/O backend. This allows the clients to run against a simulated chip
+ * instead of the hardware.
+ */
+struct nct6795d_io_ops {
+	/* Request the two ports starting at port, waiting if they are busy */
+	bool (*request)(void *priv, u16 port);
+	void (*release)(void *priv, u16 port);
+	u8 (*inb)(void *priv, u16 port);
+	void (*outb)(void *priv, u8 val, u16 port);
+};
+
+struct nct6795d_io_count {
+	u64 reads;
+	u64 writes;
+	u64 sessions;
+};
+
+struct nct6795d_io {
+	const struct nct6795d_io_ops *ops;
+	void *priv;
+	/* Port accesses and configuration mode sessions, when accounted */
+	struct nct6795d_io_count count;
+};
+
+#define NCT6795D_HIST_BUCKETS 40
+
+/*
+ * Histogram of durations in ns. Bucket i counts the durations which most
+ * significant bit is bit i - 1, i.e. durations in [2^(i - 1), 2^i).
+ */
+struct nct6795d_hist {
+	u64 buckets[NCT6795D_HIST_BUCKETS];
+	u64 count;
+	u64 max_ns;
+};
+
+static inline void nct6795d_hist_add(struct nct6795d_hist *hist, u64 ns)
+{
+	hist->buckets[min_t(int, fls64(ns), NCT6795D_HIST_BUCKETS - 1)]++;
+	hist->count++;
+	hist->max_ns = max(hist->max_ns, ns);
+}
+
+void nct6795d_hist_show(struct seq_file *s, const char *name,
+			const struct nct6795d_hist *hist);
+
+struct nct6795d_sio_client;
+
+/*
+ * Register a client of the Super I/O at base_port, accessed through io, or
+ * through the I/O ports if io is NULL. Clients share a session if they use
+ * the same io and base_port. name identifies the client in statistics and
+ * must outlive it.
+ */
+struct nct6795d_sio_client *nct6795d_sio_client_get(struct nct6795d_io *io,
+						     u16 base_port,
+						     const char *name);
+void nct6795d_sio_client_put(struct nct6795d_sio_client *client);
+
+/*
+ * Keep the session open across accesses until nct6795d_sio_put() is called.
+ */
+void nct6795d_sio_get(struct nct6795d_sio_client *client);
+void nct6795d_sio_put(struct nct6795d_sio_client *client);
+
+/*
+ * Accesses must be done between nct6795d_sio_begin(), which returns -EBUSY if
+ * the I/O region could not be requested, and nct6795d_sio_end().
+ */
+int nct6795d_sio_begin(struct nct6795d_sio_client *client);
+void nct6795d_sio_end(struct nct6795d_sio_client *client);
+void nct6795d_sio_select(struct nct6795d_sio_client *client, int ld);
+u8 nct6795d_sio_inb(struct nct6795d_sio_client *client, u8 reg);
+void nct6795d_sio_outb(struct nct6795d_sio_client *client, u8 reg, u8 val);
+
+/*
+ * Called between the chunks of a large update, to leave the configuration mode
+ * if it has been held for too long.
+ */
+void nct6795d_sio_yield(struct nct6795d_sio_client *client);
+
+/* Leave the configuration mode now if the session is open */
+void nct6795d_sio_flush(struct nct6795d_sio_client *client);
+
+/*
+ * Accounting of the port I/O and of the session usage, disabled by default.
+ * It is enabled while at least one nct6795d_sio_accounting_get() is not
+ * balanced by a put.
+ */
+void nct6795d_sio_accounting_get(void);
+void nct6795d_sio_accounting_put(void);
+
+/*
+ * Port I/O performed so far for client. Closing a session is accounted to the
+ * client which opened it.
+ */
+void nct6795d_sio_io_count(struct nct6795d_sio_client *client,
+			   struct nct6795d_io_count *count);
+
+#ifdef NCT6795D_TESTS
+/*
+ * Set chunk_hold_us and return its previous value. 0 lets the tests count the
+ * port I/O of an operation without yields cutting it into several sessions.
+ */
+unsigned int nct6795d_sio_set_chunk_hold_us(unsigned int us);
+#endif
+
+/* Show the statistics of the session of client, and of all its clients */
+void nct6795d_sio_stats_show(struct seq_file *s,
+			     struct nct6795d_sio_client *client);
+void nct6795d_sio_clients_show(struct seq_file *s,
+			       struct nct6795d_sio_client *client);
+void nct6795d_sio_latency_show(struct seq_file *s,
+			       struct nct6795d_sio_client *client);
+
+#endif /* _NCT6795D_SIO_H */